@@ -0,0 +1,111 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_ACL_HPP__
+#define __LIZARD_ACL_HPP__
+
+#include <stdint.h>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+IPv4/IPv6 allow/deny list with longest-prefix match.
+
+Rules file format (one rule per line, '#' starts a comment):
+
+    deny  10.0.0.0/8
+    allow 10.1.0.0/16
+    deny  2001:db8::/32
+
+The longest matching prefix wins, an address without any match is allowed.
+Prefixes are kept in a multibit trie with 4-bit stride and controlled prefix
+expansion, so lookup costs at most 8 (IPv4) or 32 (IPv6) node visits
+regardless of the number of rules.
+
+*/
+class acl
+{
+public:
+
+    struct rule
+    {
+        bool allow;
+        int family;
+        int prefix_len;
+        uint8_t addr[16];
+
+        uint64_t hits;
+
+        std::string to_string()const;
+    };
+
+private:
+
+    enum {STRIDE = 4};
+    enum {FANOUT = 1 << STRIDE};
+
+    struct node
+    {
+        uint32_t child[FANOUT];
+        int32_t  rule_id[FANOUT];
+
+        node();
+    };
+
+    std::vector<rule> rules;
+
+    std::vector<node> nodes_v4;
+    std::vector<node> nodes_v6;
+
+    int32_t default_v4;
+    int32_t default_v6;
+
+    uint64_t allowed_num;
+    uint64_t denied_num;
+
+    void insert(std::vector<node>& nodes, int32_t& default_rule, const uint8_t * key, int prefix_len, int32_t id);
+    int32_t lookup(const std::vector<node>& nodes, int32_t default_rule, const uint8_t * key, int key_len)const;
+
+    void add_rule(const char * line, int line_no);
+
+public:
+
+    acl();
+    ~acl();
+
+    void load_from_file(const char * file_name);
+
+    // returns index of matched rule or -1
+    int match(const struct sockaddr * sa)const;
+
+    // checks address and updates hit counters
+    bool allowed(const struct sockaddr * sa);
+
+    size_t rules_num()const;
+    const rule& get_rule(size_t i)const;
+
+    uint64_t get_allowed_num()const;
+    uint64_t get_denied_num()const;
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
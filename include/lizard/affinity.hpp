@@ -0,0 +1,79 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_AFFINITY_HPP__
+#define __LIZARD_AFFINITY_HPP__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Placement of server threads on CPUs and NUMA nodes.
+
+CPU lists use the kernel format: "0-3,8,10-11".
+
+Without NUMA nodes every thread kind is pinned to its own CPU list (if set).
+With NUMA nodes easy and hard workers are spread round-robin over the nodes:
+a worker is pinned to the node's CPUs (intersected with the worker CPU list if
+one is set) and prefers the node's memory for its allocations. Epoll and
+service threads prefer the node their CPUs belong to.
+
+apply() works on the calling thread, so every thread calls it on start.
+
+*/
+class thread_placement
+{
+public:
+    enum thread_kind {thEpoll, thEasy, thHard, thService};
+
+private:
+
+    std::vector<int> cpus[4]; // by thread_kind
+
+    std::vector<int> nodes;
+    std::vector<std::vector<int> > node_cpus;
+
+    int node_of(const std::vector<int>& cpu_list)const;
+
+    static void set_affinity(const char * name, const std::vector<int>& cpu_list);
+    static void set_mempolicy(const char * name, int node);
+
+public:
+
+    thread_placement();
+
+    // throws lizard::error on malformed lists or unknown nodes
+    void init(const std::string& epoll_cpus, const std::string& easy_cpus, const std::string& hard_cpus,
+            const std::string& service_cpus, const std::string& numa_nodes);
+
+    bool empty()const;
+
+    // NUMA node the threads of this kind are bound to, -1 if none or several
+    int node_of_kind(thread_kind kind)const;
+
+    void apply(thread_kind kind, size_t index, const char * name)const;
+
+    static void parse_cpu_list(const char * str, std::vector<int>& res);
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
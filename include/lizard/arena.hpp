@@ -0,0 +1,76 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_ARENA_HPP__
+#define __LIZARD_ARENA_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Bump allocator for the memory of one request.
+
+alloc() carves blocks from chunks and never frees them one by one; reset()
+gives all chunks back at once. Chunks come from a small per-thread cache in
+front of the page pool, so a chunk freed on the epoll thread may serve the
+next request on any worker. Blocks bigger than a quarter of a chunk get a
+chunk of their own.
+
+*/
+class arena
+{
+public:
+    enum {CHUNK_SZ = 16384};  // including the chunk header
+    enum {CACHE_CHUNKS = 32}; // per thread
+
+private:
+
+    struct chunk
+    {
+        chunk *  next;
+        size_t   size;        // whole chunk
+        size_t   used;        // including the header
+    };
+
+    chunk *  head;            // the chunk being filled comes first
+    size_t   allocated;       // bytes handed out since reset()
+
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+    static chunk * get_chunk(size_t sz);
+    static void put_chunk(chunk * c);
+
+public:
+
+    arena();
+    ~arena();
+
+    // align must be a power of two; 0 if there is no memory
+    void * alloc(size_t sz, size_t align);
+
+    void reset();
+
+    size_t get_allocated()const;
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
@@ -17,7 +17,9 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <lizard/affinity.hpp>
 #include <string>
+#include <unistd.h>
 #include <utils/error.hpp>
 #include <utils/parxml.hpp>
 
@@ -36,6 +38,7 @@ struct lz_config : public xmlobject
         std::string log_level;
         std::string access_log_file_name;
         std::string log_config_str;
+        std::string acl_file_name;
 
         struct STATS : public xmlobject
         {
@@ -72,6 +75,7 @@ struct lz_config : public xmlobject
             std::string port;
             int connection_timeout;
             int idle_timeout;
+            int timer_threads;
 
             std::string library;
             std::string params;
@@ -79,10 +83,23 @@ struct lz_config : public xmlobject
             int easy_threads;
             int hard_threads;
 
+            int hard_threads_min;
+            int hard_threads_max;
+            int hard_scale_wait;
+            int hard_scale_idle;
+
+            int hard_timeout;
+
             int easy_queue_limit;
             int hard_queue_limit;
 
-            PLUGIN() : connection_timeout(0), idle_timeout(0), easy_threads(1), hard_threads(0), easy_queue_limit(0), hard_queue_limit(0){}
+            bool lockfree_queues;
+            bool work_stealing;
+            bool inline_easy;
+
+            PLUGIN() : connection_timeout(0), idle_timeout(0), timer_threads(1), easy_threads(1), hard_threads(0),
+                hard_threads_min(0), hard_threads_max(0), hard_scale_wait(100), hard_scale_idle(30), hard_timeout(0), easy_queue_limit(0), hard_queue_limit(0),
+                lockfree_queues(false), work_stealing(false), inline_easy(false){}
 
             void determine(xmlparser *p)
             {
@@ -90,6 +107,7 @@ struct lz_config : public xmlobject
                 DET_MEMB(port);
                 DET_MEMB(connection_timeout);
                 DET_MEMB(idle_timeout);
+                DET_MEMB(timer_threads);
 
                 DET_MEMB(library);
                 DET_MEMB(params);
@@ -97,8 +115,19 @@ struct lz_config : public xmlobject
                 DET_MEMB(easy_threads);
                 DET_MEMB(hard_threads);
 
+                DET_MEMB(hard_threads_min);
+                DET_MEMB(hard_threads_max);
+                DET_MEMB(hard_scale_wait);
+                DET_MEMB(hard_scale_idle);
+
+                DET_MEMB(hard_timeout);
+
                 DET_MEMB(easy_queue_limit);
                 DET_MEMB(hard_queue_limit);
+
+                DET_MEMB(lockfree_queues);
+                DET_MEMB(work_stealing);
+                DET_MEMB(inline_easy);
             }
 
             void clear()
@@ -107,6 +136,7 @@ struct lz_config : public xmlobject
                 port.clear();
                 connection_timeout = 0;
                 idle_timeout = 0;
+                timer_threads = 1;
 
                 library.clear();
                 params.clear();
@@ -114,8 +144,19 @@ struct lz_config : public xmlobject
                 easy_threads = 1;
                 hard_threads = 0;
 
+                hard_threads_min = 0;
+                hard_threads_max = 0;
+                hard_scale_wait = 100;
+                hard_scale_idle = 30;
+
+                hard_timeout = 0;
+
                 easy_queue_limit = 0;
                 hard_queue_limit = 0;
+
+                lockfree_queues = false;
+                work_stealing = false;
+                inline_easy = false;
             }
 
             void check(const char *par, const char *ns)
@@ -129,11 +170,203 @@ struct lz_config : public xmlobject
 
                 if (0 == connection_timeout) throw error ("<%s:connection_timeout> is not set or set to 0", curns);
                 if (0 == easy_threads) throw error ("<%s:easy_threads> is set to 0", curns);
+                if (timer_threads <= 0) throw error ("<%s:timer_threads> must be positive", curns);
+                if (hard_timeout < 0) throw error ("<%s:hard_timeout> is negative", curns);
+
+                if (hard_threads_max)
+                {
+                    if (0 == hard_threads) throw error ("<%s:hard_threads> is set to 0, but <hard_threads_max> is set", curns);
+                    if (hard_threads_max < hard_threads) throw error ("<%s:hard_threads_max> is less than <hard_threads>", curns);
+                    if (hard_threads_min > hard_threads) throw error ("<%s:hard_threads_min> is greater than <hard_threads>", curns);
+                    if (hard_scale_wait <= 0) throw error ("<%s:hard_scale_wait> must be positive", curns);
+                    if (hard_scale_idle <= 0) throw error ("<%s:hard_scale_idle> must be positive", curns);
+                }
+            }
+        };
+
+        struct AFFINITY : public xmlobject
+        {
+            std::string epoll_cpus;
+            std::string easy_cpus;
+            std::string hard_cpus;
+            std::string service_cpus;
+            std::string numa_nodes;
+
+            AFFINITY(){}
+
+            void determine(xmlparser *p)
+            {
+                DET_MEMB(epoll_cpus);
+                DET_MEMB(easy_cpus);
+                DET_MEMB(hard_cpus);
+                DET_MEMB(service_cpus);
+                DET_MEMB(numa_nodes);
+            }
+
+            void clear()
+            {
+                epoll_cpus.clear();
+                easy_cpus.clear();
+                hard_cpus.clear();
+                service_cpus.clear();
+                numa_nodes.clear();
+            }
+
+            static void check_list(const char * curns, const char * name, const std::string& str, std::vector<int>& res)
+            {
+                try
+                {
+                    thread_placement::parse_cpu_list(str.c_str(), res);
+                }
+                catch (const std::exception& e)
+                {
+                    throw error ("<%s:%s> %s", curns, name, e.what());
+                }
+            }
+
+            static void check_cpus(const char * curns, const char * name, const std::string& str)
+            {
+                std::vector<int> cpus;
+                check_list(curns, name, str, cpus);
+
+                const long cpus_num = sysconf(_SC_NPROCESSORS_CONF);
+
+                // the list is sorted
+                if (!cpus.empty() && cpus_num > 0 && cpus.back() >= cpus_num)
+                    throw error ("<%s:%s> has cpu %d, the system has %ld cpus", curns, name, cpus.back(), cpus_num);
+            }
+
+            void check(const char *par, const char *ns)
+            {
+                char curns [SRV_BUF];
+                snprintf(curns, SRV_BUF, "%s:%s", par, ns);
+
+                check_cpus(curns, "epoll_cpus", epoll_cpus);
+                check_cpus(curns, "easy_cpus", easy_cpus);
+                check_cpus(curns, "hard_cpus", hard_cpus);
+                check_cpus(curns, "service_cpus", service_cpus);
+
+                std::vector<int> nodes;
+                check_list(curns, "numa_nodes", numa_nodes, nodes);
+
+                for (size_t i = 0; i < nodes.size(); i++)
+                {
+                    char path[256];
+                    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", nodes[i]);
+
+                    if (0 != access(path, F_OK)) throw error ("<%s:numa_nodes> has node %d, the system has no such node", curns, nodes[i]);
+                }
+            }
+        };
+
+        struct MEMORY : public xmlobject
+        {
+            int page_pool_retain;
+            int pool_idle_release;
+
+            std::string huge_pages;
+            int connection_region;
+            int prefault;
+
+            int read_headers_page;
+            int write_title_page;
+            int write_headers_page;
+            int write_body_page;
+
+            int post_memory_max;
+            int post_max;
+            std::string post_spill_dir;
+
+            int memory_budget;
+
+            int warmup_connections;
+            int warmup_pages;
+
+            MEMORY() : page_pool_retain(1024), pool_idle_release(60), huge_pages("off"), connection_region(65536), prefault(0), read_headers_page(8192), write_title_page(8192), write_headers_page(4096),
+                write_body_page(32768), post_memory_max(1048576), post_max(67108864), post_spill_dir("/tmp"),
+                memory_budget(0), warmup_connections(0), warmup_pages(0){}
+
+            void determine(xmlparser *p)
+            {
+                DET_MEMB(page_pool_retain);
+                DET_MEMB(pool_idle_release);
+
+                DET_MEMB(huge_pages);
+                DET_MEMB(connection_region);
+                DET_MEMB(prefault);
+
+                DET_MEMB(read_headers_page);
+                DET_MEMB(write_title_page);
+                DET_MEMB(write_headers_page);
+                DET_MEMB(write_body_page);
+
+                DET_MEMB(post_memory_max);
+                DET_MEMB(post_max);
+                DET_MEMB(post_spill_dir);
+
+                DET_MEMB(memory_budget);
+
+                DET_MEMB(warmup_connections);
+                DET_MEMB(warmup_pages);
+            }
+
+            void clear()
+            {
+                page_pool_retain = 1024;
+                pool_idle_release = 60;
+
+                huge_pages = "off";
+                connection_region = 65536;
+                prefault = 0;
+
+                read_headers_page = 8192;
+                write_title_page = 8192;
+                write_headers_page = 4096;
+                write_body_page = 32768;
+
+                post_memory_max = 1048576;
+                post_max = 67108864;
+                post_spill_dir = "/tmp";
+
+                memory_budget = 0;
+
+                warmup_connections = 0;
+                warmup_pages = 0;
+            }
+
+            void check(const char *par, const char *ns)
+            {
+                char curns [SRV_BUF];
+                snprintf(curns, SRV_BUF, "%s:%s", par, ns);
+
+                if (page_pool_retain < 0) throw error ("<%s:page_pool_retain> is negative", curns);
+                if (pool_idle_release < 0) throw error ("<%s:pool_idle_release> is negative", curns);
+
+                if (huge_pages != "off" && huge_pages != "transparent" && huge_pages != "hugetlb")
+                    throw error ("<%s:huge_pages> must be off, transparent or hugetlb", curns);
+                if (connection_region < 0) throw error ("<%s:connection_region> is negative", curns);
+
+                // the title page holds the status line and all response headers
+                if (read_headers_page < 512) throw error ("<%s:read_headers_page> is less than 512", curns);
+                if (write_title_page < 512) throw error ("<%s:write_title_page> is less than 512", curns);
+                if (write_headers_page < 512) throw error ("<%s:write_headers_page> is less than 512", curns);
+                if (write_body_page < 512) throw error ("<%s:write_body_page> is less than 512", curns);
+
+                if (post_memory_max < 0) throw error ("<%s:post_memory_max> is negative", curns);
+                if (post_max < 0) throw error ("<%s:post_max> is negative", curns);
+                if (post_max > post_memory_max && post_spill_dir.empty()) throw error ("<%s:post_spill_dir> is empty", curns);
+
+                if (memory_budget < 0) throw error ("<%s:memory_budget> is negative", curns);
+
+                if (warmup_connections < 0) throw error ("<%s:warmup_connections> is negative", curns);
+                if (warmup_pages < 0) throw error ("<%s:warmup_pages> is negative", curns);
             }
         };
 
         STATS stats;
         PLUGIN plugin;
+        AFFINITY affinity;
+        MEMORY memory;
 
         void determine(xmlparser *p)
         {
@@ -142,9 +375,12 @@ struct lz_config : public xmlobject
             DET_MEMB(log_level);
             DET_MEMB(access_log_file_name);
             DET_MEMB(log_config_str);
+            DET_MEMB(acl_file_name);
 
             DET_MEMB(stats);
             DET_MEMB(plugin);
+            DET_MEMB(affinity);
+            DET_MEMB(memory);
         }
 
         void clear()
@@ -154,9 +390,12 @@ struct lz_config : public xmlobject
             log_level.clear();
             access_log_file_name.clear();
             log_config_str.clear();
+            acl_file_name.clear();
 
             stats.clear();
             plugin.clear();
+            affinity.clear();
+            memory.clear();
         }
 
         void check()
@@ -165,8 +404,10 @@ struct lz_config : public xmlobject
 
             if (log_level.empty()) throw error ("<%s:log_level> is empty in config", curns);
 
-            stats .check(curns, "stats");
-            plugin.check(curns, "plugin");
+            stats   .check(curns, "stats");
+            plugin  .check(curns, "plugin");
+            affinity.check(curns, "affinity");
+            memory  .check(curns, "memory");
         }
     } root;
 
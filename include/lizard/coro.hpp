@@ -0,0 +1,358 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_CORO_HPP__
+#define __LIZARD_CORO_HPP__
+
+/*
+
+Coroutine plugin interface (C++20, header only; the server itself does not
+need a C++20 compiler).
+
+    class my_plugin : public lizard::coro_plugin
+    {
+    public:
+        my_plugin(lizard::server_callback * srv) : lizard::coro_plugin(srv){}
+
+        lizard::coro_handler handle(lizard::task * tsk)
+        {
+            int fd = connect_to_backend();              // non-blocking
+
+            co_await wait_fd(fd, EPOLLOUT);             // resumed on the epoll thread
+            write_request(fd);
+
+            uint32_t ev = co_await wait_fd(fd, EPOLLIN);
+            ...
+            co_await sleep(10000);                      // 10 ms, epoll thread
+
+            co_await offload_hard(tsk);                 // resumed on a hard thread
+            heavy_work(tsk);
+
+            co_return rSuccess;
+        }
+        ...
+    };
+
+The handler starts on the easy thread (or on the epoll thread with
+<inline_easy>). If it completes without suspending, its result is returned
+from handle_easy() as usual; otherwise handle_easy() returns rAsync and the
+result is handed to the server by complete_task() when the coroutine ends,
+on whatever thread it was resumed on. Code resumed on the epoll thread
+must not block.
+
+*/
+
+#if __cplusplus >= 202002L && defined(__has_include)
+#if __has_include(<coroutine>)
+
+#include <coroutine>
+#include <lizard/plugin.hpp>
+#include <map>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+class coro_handler
+{
+public:
+
+    struct promise_type
+    {
+        // sRunning while handle_easy() waits for the first suspension,
+        // the one who leaves sRunning first decides how the result is delivered
+        enum {sRunning, sDetached, sDoneInline};
+
+        int state = sRunning;
+        int result = plugin::rError;
+
+        lizard::task * tsk = nullptr;
+        server_callback * srv = nullptr;
+
+        coro_handler get_return_object()
+        {
+            return coro_handler(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter
+        {
+            bool await_ready() noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+            {
+                promise_type& p = h.promise();
+
+                int expected = sRunning;
+                if (__atomic_compare_exchange_n(&p.state, &expected, (int)sDoneInline, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    return; // handle_easy() picks the result up
+                }
+
+                lizard::task * tsk = p.tsk;
+                server_callback * srv = p.srv;
+                int result = p.result;
+
+                h.destroy();
+
+                srv->complete_task(tsk, result);
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(int r) { result = r; }
+        void unhandled_exception() { result = plugin::rError; }
+    };
+
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    explicit coro_handler(handle_type h) : coro(h) {}
+    coro_handler(coro_handler&& other) noexcept : coro(other.coro) { other.coro = nullptr; }
+
+    coro_handler(const coro_handler&) = delete;
+    coro_handler& operator=(const coro_handler&) = delete;
+
+    ~coro_handler()
+    {
+        if (coro)
+        {
+            coro.destroy(); // never started
+        }
+    }
+
+    // runs the coroutine up to its first suspension: returns its result if it
+    // has finished, rAsync if it will finish with complete_task()
+    int start(lizard::task * tsk, server_callback * srv)
+    {
+        handle_type h = coro;
+        coro = nullptr;
+
+        promise_type& p = h.promise();
+        p.tsk = tsk;
+        p.srv = srv;
+
+        h.resume();
+
+        int expected = promise_type::sRunning;
+        if (__atomic_compare_exchange_n(&p.state, &expected, (int)promise_type::sDetached, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return plugin::rAsync; // the frame belongs to the coroutine now
+        }
+
+        int result = p.result;
+        h.destroy();
+
+        return result;
+    }
+
+private:
+    handle_type coro;
+};
+
+//-----------------------------------------------------------------
+
+class coro_plugin : public plugin
+{
+protected:
+
+    server_callback * srv;
+
+private:
+
+    std::mutex offload_mutex;
+    std::map<lizard::task *, std::coroutine_handle<> > offloaded;
+
+public:
+
+    explicit coro_plugin(server_callback * s) : plugin(s), srv(s) {}
+
+    virtual coro_handler handle(lizard::task * tsk) = 0;
+
+    int handle_easy(lizard::task * tsk)
+    {
+        return handle(tsk).start(tsk, srv);
+    }
+
+    // hard threads only resume coroutines that asked for offload_hard()
+    int handle_hard(lizard::task * tsk)
+    {
+        std::coroutine_handle<> h;
+        {
+            std::lock_guard<std::mutex> lock(offload_mutex);
+
+            std::map<lizard::task *, std::coroutine_handle<> >::iterator it = offloaded.find(tsk);
+            if (it == offloaded.end())
+            {
+                return rError;
+            }
+
+            h = it->second;
+            offloaded.erase(it);
+        }
+
+        h.resume();
+
+        return rAsync;
+    }
+
+    //-------------------------------------------------------------
+
+    struct fd_awaiter
+    {
+        server_callback * srv;
+        int fd;
+        uint32_t events;
+
+        std::coroutine_handle<> coro;
+        uint32_t revents = 0;
+
+        static void ready(void * arg, uint32_t ev)
+        {
+            fd_awaiter * self = (fd_awaiter *)arg;
+
+            self->revents = ev;
+            self->coro.resume();
+        }
+
+        bool await_ready() { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            coro = h;
+
+            if (!srv->watch_fd(fd, events, &ready, this))
+            {
+                revents = EPOLLERR;
+                return false;
+            }
+
+            return true;
+        }
+
+        uint32_t await_resume() { return revents; }
+    };
+
+    // waits for EPOLLIN/EPOLLOUT on fd, returns the events; resumes on the epoll thread
+    fd_awaiter wait_fd(int fd, uint32_t events)
+    {
+        return fd_awaiter{srv, fd, events, nullptr, 0};
+    }
+
+    struct sleep_awaiter
+    {
+        server_callback * srv;
+        uint64_t usec;
+
+        int tfd = -1;
+        std::coroutine_handle<> coro;
+
+        static void ready(void * arg, uint32_t)
+        {
+            sleep_awaiter * self = (sleep_awaiter *)arg;
+
+            close(self->tfd);
+            self->tfd = -1;
+
+            self->coro.resume();
+        }
+
+        bool await_ready() { return 0 == usec; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            coro = h;
+
+            tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (-1 == tfd)
+            {
+                return false;
+            }
+
+            struct itimerspec its = {};
+            its.it_value.tv_sec = usec / 1000000;
+            its.it_value.tv_nsec = (usec % 1000000) * 1000;
+
+            if (0 != timerfd_settime(tfd, 0, &its, 0) || !srv->watch_fd(tfd, EPOLLIN, &ready, this))
+            {
+                close(tfd);
+                tfd = -1;
+
+                return false;
+            }
+
+            return true;
+        }
+
+        void await_resume() {}
+    };
+
+    // resumes on the epoll thread after 'usec' microseconds
+    sleep_awaiter sleep(uint64_t usec)
+    {
+        return sleep_awaiter{srv, usec, -1, nullptr};
+    }
+
+    struct hard_awaiter
+    {
+        coro_plugin * plugin;
+        lizard::task * tsk;
+
+        bool await_ready() { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            {
+                std::lock_guard<std::mutex> lock(plugin->offload_mutex);
+                plugin->offloaded[tsk] = h;
+            }
+
+            if (plugin->srv->complete_task(tsk, rHard))
+            {
+                return true;
+            }
+
+            // no room in the hard pool: go on where we are
+            std::lock_guard<std::mutex> lock(plugin->offload_mutex);
+            plugin->offloaded.erase(tsk);
+
+            return false;
+        }
+
+        void await_resume() {}
+    };
+
+    // moves the rest of the handler to a hard thread (or keeps it on the
+    // current one if the hard queue is full)
+    hard_awaiter offload_hard(lizard::task * tsk)
+    {
+        return hard_awaiter{this, tsk};
+    }
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
+#endif
+
+#endif
@@ -18,7 +18,7 @@
 #include <Judy.h>
 #include <lizard/http.hpp>
 #include <lizard/plugin.hpp>
-#include <lizard/pool/pool.hpp>
+#include <lizard/pool/magazine_pool.hpp>
 #include <lizard/statistics.hpp>
 #include <lizard/timeline.hpp>
 #include <pthread.h>
@@ -46,13 +46,22 @@ class fd_map
         uint64_t get_lifetime()const;
     };
 
-    pool_ns::pool<container, 500> elements_pool;
+public:
+    enum {OBJECTS_PER_PAGE = 500};
+
+    typedef pool_ns::magazine_pool<container, OBJECTS_PER_PAGE> elements_pool_t;
+
+private:
+    elements_pool_t elements_pool;
 
     Pvoid_t map_handle;
 
     timeline timeouts;
 
     double min_lifetime, mid_lifetime, max_lifetime;
+
+    uint64_t pool_idle_time; // us, 0 keeps free pages
+    uint64_t last_trim;
 public:
 
     fd_map();
@@ -67,9 +76,23 @@ public:
 
     void kill_oldest(int timeout);
 
+    void set_pool_idle_time(int seconds);
+    void set_page_source(pool_ns::page_source * src);
+
+    // preallocates connection objects; returns the number of new pool pages
+    size_t reserve(size_t connections);
+
+    // bytes of one pool page
+    static size_t pool_page_size();
+
     int min_timeout()const;
 
     size_t fd_count()const;
+
+    size_t pool_depot_magazines()const;
+    static size_t object_size();
+    void get_pool_stats(std::vector<elements_pool_t::cache_stats>& res)const;
+    void get_pool_occupancy(elements_pool_t::occupancy_stats& res)const;
 };
 
 //-----------------------------------------------------------------
@@ -0,0 +1,92 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_HEADER_TABLE_HPP__
+#define __LIZARD_HEADER_TABLE_HPP__
+
+#include <lizard/plugin.hpp>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Headers of one request.
+
+Every header is kept with its case-insensitive hash, an open addressing
+index over the hashes finds a key in O(1). The well-known headers of
+task::request_header_t are recognized while the table is filled and get
+their own slots. Equal keys stay in the table in order, lookups find the
+first one. Keys and values point into the request buffer.
+
+The vectors keep their capacity between requests of a connection.
+
+*/
+class header_table
+{
+public:
+
+    struct item
+    {
+        const char * key;
+        const char * value;
+        uint32_t     key_len;
+        uint32_t     value_len;
+        uint32_t     hash;
+    };
+
+    enum {MIN_SLOTS = 32}; // a power of two
+
+private:
+
+    std::vector<item>     items;
+    std::vector<uint32_t> index;    // item number + 1, 0 is a free slot
+    size_t                indexed;  // distinct keys
+
+    uint32_t known[task::KNOWN_HEADERS_NUM]; // item number + 1
+
+    bool insert(uint32_t n);
+    void rehash(size_t slots);
+
+public:
+
+    header_table();
+
+    void clear();
+
+    // returns the task::request_header_t of the key, -1 for other ones
+    int add(const char * key, size_t key_len, const char * value, size_t value_len);
+
+    size_t size()const;
+    const item& operator[](size_t i)const;
+
+    // 0 if there is no such header
+    const item * find(const char * key, size_t key_len)const;
+    const item * find(task::request_header_t h)const;
+
+    static uint32_t hash(const char * key, size_t len);
+
+    // -1 if the key is not a well-known one
+    static int known_header(const char * key, size_t len, uint32_t h);
+    static const char * known_name(int h);
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
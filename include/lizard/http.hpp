@@ -15,7 +15,11 @@
 #ifndef __LIZARD_CONNECTION_HPP
 #define __LIZARD_CONNECTION_HPP
 
+#include <lizard/arena.hpp>
+#include <lizard/header_table.hpp>
+#include <lizard/http_scan.hpp>
 #include <lizard/mem_chunk.hpp>
+#include <lizard/mpsc_list.hpp>
 #include <lizard/plugin.hpp>
 #include <lizard/utils.hpp>
 #include <stdint.h>
@@ -25,10 +29,13 @@ namespace lizard
 
 //---------------------------------------------------------------------------------------
 
-class http : public lizard::task
+class http : public lizard::task, public mpsc_node
 {
 public:
-    enum http_state {sUndefined, sReadingHead, sReadingHeaders, sReadingPost, sReadyToHandle, sWriting, sDone};
+    enum http_state {sUndefined, sReadingHead, sReadingPost, sReadyToHandle, sWriting, sDone};
+
+    // 503 answers of the server itself, see set_canned_reply()
+    enum canned_reply {cannedMemoryBudget, cannedEasyQueue, cannedHardQueue, cannedEasyError, cannedHardError, CANNED_NUM};
 
 protected:
 
@@ -36,13 +43,17 @@ protected:
 
     static const char ** http_codes;
 
+    // page sizes of the buffers below, see <memory>
+    static size_t read_headers_sz;
+    static size_t write_title_sz;
+    static size_t write_headers_sz;
+    static size_t write_body_sz;
 
-    enum {MAX_HEADER_ITEMS = 16};
-
-    enum {READ_HEADERS_SZ = 8192};
-    enum {WRITE_TITLE_SZ = 8192};
-    enum {WRITE_HEADERS_SZ = 4096};
-    enum {WRITE_BODY_SZ = 32768};
+    // request bodies above post_memory_max go to a file in post_spill_dir,
+    // bodies above post_max are refused
+    static size_t post_memory_max;
+    static size_t post_max;
+    static std::string post_spill_dir;
 
     int fd;
 
@@ -58,23 +69,27 @@ protected:
 
     volatile bool locked;
 
-    mem_chunk<READ_HEADERS_SZ>    in_headers;
+    uint64_t queued_time; // when the task was put to a worker queue, us
+    uint64_t hard_seq;    // non-zero while the hard handler budget is watched
+
+    // buffers hold pages only while their phase lasts: request ones until
+    // the response is committed, response ones until it is written
+    mem_chunk                     in_headers;
+    size_t                        head_scanned; // bytes of in_headers searched for the end of the head
+    http_head                     head;
     mem_block                     in_post;
+    size_t                        post_len;    // Content-Length, the body buffer is set up in parse_post()
+    bool                          post_ready;  // false while the body waits for memory
 
-    mem_chunk<WRITE_TITLE_SZ>     out_title;
-    mem_chunk<WRITE_HEADERS_SZ>   out_headers;
-    mem_chunk<WRITE_BODY_SZ>      out_post;
+    mem_chunk                     out_title;
+    mem_chunk                     out_headers;
+    mem_chunk                     out_post;
 
-    http_state state_;
+    arena                         req_arena; // task::alloc(), reset with the request buffers
 
-    struct header_item
-    {
-        const char *key;
-        const char *value;
-    }
-    header_items[MAX_HEADER_ITEMS];
+    http_state state_;
 
-    int header_items_num;
+    header_table headers;
 
     task::request_method_t method;
 
@@ -85,8 +100,14 @@ protected:
 
     struct in_addr in_ip;
 
-    const char *uri_path;
-    const char *uri_params;
+    string_view uri_path;
+    string_view uri_params;
+
+    // decoded on demand, see get_request_query()
+    request_params query;
+    request_params form;
+    bool query_parsed;
+    bool form_parsed;
 
     int response_status;
 
@@ -96,21 +117,32 @@ protected:
     bool network_tryread();
     bool network_trywrite();
 
-    char * read_header_line();
-    int parse_title();
-    int parse_header_line();
+    int parse_head();
+    int parse_header(int known, char * val);
     int parse_post();
 
+    void reply_error(int status);
+
     int commit();
     int write_data();
 
+    void release_request();
+
 public:
     http();
     ~http();
 
+    // for connections initialized after the call
+    static void set_page_sizes(size_t read_headers, size_t write_title, size_t write_headers, size_t write_body);
+    static void set_post_limits(size_t memory_max, size_t max, const std::string& spill_dir);
+
     void init(int fd, const struct in_addr& ip);
     void destroy();
 
+    // closes the socket of a task that is still locked by a worker; buffers stay
+    // until the task comes back and is released
+    void abandon();
+
     bool ready()const;
 
     void allow_read();
@@ -125,6 +157,15 @@ public:
     void unlock();
     bool is_locked()const;
 
+    // the body is not read until the memory budget allows it
+    bool post_paused()const;
+
+    void set_queued_time(uint64_t);
+    uint64_t get_queued_time()const;
+
+    void set_hard_seq(uint64_t);
+    uint64_t get_hard_seq()const;
+
     int get_fd()const;
 
     // Качает данные из сокета. О результатах работы можно судить по изменению state
@@ -148,15 +189,31 @@ public:
     const uint8_t *  get_request_body()const;
 
     const char *     get_request_header(const char *)const;
+    const char *     get_request_header(request_header_t)const;
     size_t           get_request_headers_num()const;
     const char *     get_request_header_key(int)const;
     const char *     get_request_header_value(int)const;
 
+    string_view      get_request_uri_path_view()const;
+    string_view      get_request_uri_params_view()const;
+    string_view      get_request_header_view(const string_view& key)const;
+    string_view      get_request_header_view(request_header_t)const;
+    string_view      get_request_header_key_view(int)const;
+    string_view      get_request_header_value_view(int)const;
+
+    const request_params& get_request_query();
+    const request_params& get_request_form();
+
     void set_response_status(int);
     void set_keepalive(bool);
     void set_cache(bool);
     void set_response_header(const char * header_nm, const char * val);
     void append_response_body(const char * data, size_t sz);
+
+    void * alloc(size_t sz, size_t align = sizeof(void *));
+
+    // status 503 with a text/plain reason, from prebuilt blocks
+    void set_canned_reply(canned_reply r);
 };
 
 //---------------------------------------------------------------------------------------
@@ -0,0 +1,89 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_HTTP_SCAN_HPP__
+#define __LIZARD_HTTP_SCAN_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+struct http_span
+{
+    uint32_t off;
+    uint32_t len;
+};
+
+// parts of a request head as offsets into its buffer
+struct http_head
+{
+    struct field
+    {
+        http_span key;   // leading spaces skipped
+        http_span value; // leading spaces skipped, up to the line end
+    };
+
+    http_span method;
+    http_span uri_path;
+    http_span uri_params;  // after '?', empty if there is none
+    http_span version;     // after "HTTP/"
+
+    uint32_t length;       // of the head with the empty line
+
+    std::vector<field> fields;
+};
+
+/*
+
+Vectorized scanning of an HTTP request head.
+
+scan_head() walks the head once: 32 bytes at a time are classified into
+line ends, colons, spaces and '?', and only these positions are looked at;
+a header line costs its line end and its first colon. Lines may end with
+"\n" or "\r\n". While the head arrives in parts, find_head_end() checks
+only the new bytes for the empty line.
+
+The AVX2 or SSE4.2 variant is picked by the cpu features at the first call,
+the scalar one is the fallback and the reference.
+
+*/
+namespace http_scan
+{
+    enum impl {implScalar, implSSE42, implAVX2, IMPLS_NUM};
+
+    // offset just past the empty line, 0 if the head is not complete yet;
+    // bytes before 'from' were looked at by an earlier call
+    size_t find_head_end(const char * buf, size_t len, size_t from = 0);
+
+    // 0 if buf[0, len) starts with a whole head (see http_head::length), -1 if
+    // the head is not complete, or an HTTP error status
+    int scan_head(const char * buf, size_t len, http_head& res);
+
+    int get_impl();
+    bool supported(int i);
+
+    // false if the cpu can't run it
+    bool set_impl(int i);
+
+    const char * impl_name(int i);
+}
+
+//-----------------------------------------------------------------
+}
+
+#endif
@@ -0,0 +1,100 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_MEM_ACCOUNTANT_HPP__
+#define __LIZARD_MEM_ACCOUNTANT_HPP__
+
+#include <lizard/mpmc_queue.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Process-wide account of request and response memory against a budget.
+
+Buffers report every page they take and give back. The fuller the budget,
+the higher the backpressure level: from NO_BODIES_PCT new request bodies are
+not read into memory, from NO_ACCEPT_PCT no connections are accepted, and at
+the budget itself requests are answered with 503. Without a budget only the
+usage is counted.
+
+*/
+class mem_accountant
+{
+public:
+    enum category {mHeaders, mBodies, mResponses, mArenas, CATEGORIES_NUM};
+
+    enum level {lvNormal, lvNoBodies, lvNoAccept, lvShed};
+
+    enum event {evBodyPaused, evAcceptPaused, evShed, EVENTS_NUM};
+
+    enum {NO_BODIES_PCT = 80};
+    enum {NO_ACCEPT_PCT = 90};
+
+private:
+
+    struct counter
+    {
+        int64_t bytes;
+        int64_t peak;
+
+        char pad[CACHE_LINE_SZ];
+
+        counter() : bytes(0), peak(0){}
+    };
+
+    counter counters[CATEGORIES_NUM];
+
+    uint64_t events[EVENTS_NUM];
+
+    size_t budget;
+
+    mem_accountant(const mem_accountant&);
+    mem_accountant& operator=(const mem_accountant&);
+
+public:
+
+    mem_accountant();
+
+    // 0 switches backpressure off
+    void init(size_t budget_bytes);
+
+    void add(int cat, size_t sz);
+    void sub(int cat, size_t sz);
+
+    size_t used()const;
+    size_t used(int cat)const;
+    size_t peak(int cat)const;
+
+    size_t get_budget()const;
+
+    int get_level()const;
+
+    void report(event ev);
+    uint64_t get_events(event ev)const;
+
+    static const char * category_name(int cat);
+    static const char * level_name(int lv);
+};
+
+//-----------------------------------------------------------------
+}
+
+extern lizard::mem_accountant mem_account;
+
+#endif
@@ -18,8 +18,14 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <lizard/config.hpp>
+#include <lizard/mem_accountant.hpp>
+#include <lizard/page_pool.hpp>
 #include <lizard/utils.hpp>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <string>
+#include <sys/mman.h>
 #include <utils/logger.hpp>
 
 namespace lizard
@@ -27,33 +33,60 @@ namespace lizard
 
 //---------------------------------------------------------------------------------------
 
-template<int data_size>
+/*
+
+Chain of pages taken from the page pool on demand. An empty chunk holds no
+memory: the first page comes with the first byte appended or read, and
+reset() gives all pages back. Without set_expand(true) only one page is used.
+The page size applies to pages taken after it is set.
+
+*/
 class mem_chunk
 {
     static Logger& slogger;
 
-    uint8_t page[data_size + 1];
+    struct page_t
+    {
+        page_t * next;
+        size_t   capacity;
+        size_t   sz;
+        size_t   current;
+        uint8_t  data[1]; // capacity + 1 bytes, there is always room for a terminating zero
+    };
 
-    size_t  sz;
-    size_t  current;
-    bool    can_expand;
+    page_t * head;
+    size_t   page_sz;
+    bool     can_expand;
+    int      account;   // mem_accountant category, -1 if not counted
 
-    mem_chunk<data_size> * next;
+    page_t * new_page()const;
+    page_t * last_page()const;
+    void insert_page(page_t * after);
 
-    void insert_page();
+    mem_chunk(const mem_chunk&);
+    mem_chunk& operator=(const mem_chunk&);
 
 public:
 
-    mem_chunk();
+    explicit mem_chunk(size_t page_sz = 4096);
     ~mem_chunk();
 
+    void set_page_size(size_t sz);
     size_t page_size()const;
+
+    // bytes taken from the page pool for a page of page_sz
+    static size_t page_alloc_size(size_t page_sz);
+
+    void set_account(int category);
+
+    bool empty()const;
+
+    // data of the first page, 0 if there is none
     const void * get_data()const;
     void * get_data();
     size_t get_data_size()const;
     size_t& marker();
     size_t get_total_data_size()const;
-    mem_chunk<data_size> * get_next()const;
 
     bool set_expand(bool exp);
 
@@ -84,9 +117,13 @@ public:
     void print();
 };
 
-template <int data_size>
-Logger& mem_chunk<data_size>::slogger = getLog("lizard");
+/*
 
+Buffer of a known size, in memory or in a temporary file. After
+resize_to_file() the data is written to an unlinked file as it arrives, and
+seal() maps the complete file read-only; get_data() is 0 until then.
+
+*/
 class mem_block
 {
     static Logger& slogger;
@@ -96,6 +133,17 @@ class mem_block
     size_t        page_sz;
     size_t        current;
 
+    int           file_fd;   // -1 while the data is in memory
+    bool          mapped;
+
+    int           account;   // mem_accountant category of the memory, -1 if not counted
+
+    mem_block(const mem_block&);
+    mem_block& operator=(const mem_block&);
+
+    bool write_to_file(const void * data, size_t data_sz);
+    bool read_to_file(int fd, bool& can_read, bool& want_read, bool& rdeof);
+
 public:
 
     explicit mem_block(size_t max_sz = 0);
@@ -109,6 +157,12 @@ public:
 
     void resize(size_t max_sz = 0);
 
+    // false if no temporary file can be created in 'dir'
+    bool resize_to_file(size_t max_sz, const char * dir);
+    void set_account(int category);
+    bool in_file()const;
+    bool seal();
+
     void reset();
 
     size_t append_data(const void * data, size_t data_sz);
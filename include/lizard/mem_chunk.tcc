@@ -22,154 +22,197 @@ inline static const T& min(const T& a, const T& b)
 }
 //-------------------------------------------------------------------------------------------------------------------
 
-template<int data_size>
-inline mem_chunk<data_size>::mem_chunk() : sz(0), current(0), can_expand(false), next(0)
+inline mem_chunk::mem_chunk(size_t sz) : head(0), page_sz(sz), can_expand(false), account(-1)
 {
-    page[0] = 0;
+
 }
 
-template<int data_size>
-inline mem_chunk<data_size>::~mem_chunk()
+inline mem_chunk::~mem_chunk()
 {
     reset();
 }
 
-template<int data_size>
-inline void mem_chunk<data_size>::insert_page()
+inline mem_chunk::page_t * mem_chunk::new_page()const
 {
-    mem_chunk<data_size> * new_chunk = new mem_chunk<data_size>;
-    new_chunk->next = this->next;
-    this->next = new_chunk;
+    const size_t alloc_sz = page_alloc_size(page_sz);
+
+    page_t * p = (page_t *)mem_pages.allocate(alloc_sz);
+
+    mem_account.add(account, alloc_sz);
+
+    p->next = 0;
+    p->capacity = page_sz;
+    p->sz = 0;
+    p->current = 0;
+    p->data[0] = 0;
+
+    return p;
 }
 
-template<int data_size>
-inline void mem_chunk<data_size>::reset()
+inline mem_chunk::page_t * mem_chunk::last_page()const
 {
-    if (next)
+    page_t * p = head;
+
+    while (p && p->next)
     {
-        delete next;
-        next = 0;
+        p = p->next;
+    }
+
+    return p;
+}
+
+inline void mem_chunk::insert_page(page_t * after)
+{
+    page_t * p = new_page();
+
+    p->next = after->next;
+    after->next = p;
+}
+
+inline void mem_chunk::reset()
+{
+    page_t * p = head;
+    head = 0;
+
+    // pages go back to the page pool one by one
+    while (p)
+    {
+        page_t * n = p->next;
+
+        mem_pages.free(p, page_alloc_size(p->capacity));
+        mem_account.sub(account, page_alloc_size(p->capacity));
+
+        p = n;
     }
 
-    sz = 0;
-    current = 0;
     can_expand = false;
 }
 
-template<int data_size>
-inline size_t mem_chunk<data_size>::page_size()const
+inline void mem_chunk::set_page_size(size_t sz)
 {
-    return data_size;
+    page_sz = sz;
 }
 
-template<int data_size>
-inline const void * mem_chunk<data_size>::get_data()const
+inline size_t mem_chunk::page_size()const
 {
-    return page;
+    return head ? head->capacity : page_sz;
 }
 
-template<int data_size>
-inline void * mem_chunk<data_size>::get_data()
+inline size_t mem_chunk::page_alloc_size(size_t sz)
 {
-    return page;
+    return offsetof(page_t, data) + sz + 1;
 }
 
-template<int data_size>
-inline size_t mem_chunk<data_size>::get_data_size()const
+inline void mem_chunk::set_account(int category)
 {
-    return sz;
+    account = category;
 }
 
-template<int data_size>
-inline size_t& mem_chunk<data_size>::marker()
+inline bool mem_chunk::empty()const
 {
-    return current;
+    return 0 == head;
+}
+
+inline const void * mem_chunk::get_data()const
+{
+    return head ? head->data : 0;
 }
 
-template<int data_size>
-inline size_t mem_chunk<data_size>::get_total_data_size()const
+inline void * mem_chunk::get_data()
 {
-    return sz + (next ? next->get_total_data_size() : 0);
+    return head ? head->data : 0;
 }
 
+inline size_t mem_chunk::get_data_size()const
+{
+    return head ? head->sz : 0;
+}
+
+inline size_t& mem_chunk::marker()
+{
+    if (0 == head)
+    {
+        head = new_page();
+    }
+
+    return head->current;
+}
 
-template<int data_size>
-inline typename lizard::mem_chunk<data_size> * mem_chunk<data_size>::get_next()const
+inline size_t mem_chunk::get_total_data_size()const
 {
-    return next;
+    size_t res = 0;
+
+    for (const page_t * p = head; p; p = p->next)
+    {
+        res += p->sz;
+    }
+
+    return res;
 }
 
-template<int data_size>
-inline bool mem_chunk<data_size>::set_expand(bool exp)
+inline bool mem_chunk::set_expand(bool exp)
 {
     bool old = can_expand;
     can_expand = exp;
     return old;
 }
 
-template<int data_size>
-inline size_t mem_chunk<data_size>::append_data(const void * data, size_t data_sz)
+inline size_t mem_chunk::append_data(const void * data, size_t data_sz)
 {
-    mem_chunk<data_size> * cur_page = this;
-
-    size_t total_to_write = data_sz;
-
-    if (next)
+    if (0 == data_sz)
     {
-        while (cur_page->next)
-        {
-            cur_page = cur_page->next;
-        }
-
-        return cur_page->append_data(data, data_sz);
+        return 0;
     }
-    else
+
+    if (0 == head)
     {
-        const uint8_t * p = static_cast<const uint8_t*>(data);
+        head = new_page();
+    }
+
+    page_t * cur_page = last_page();
 
-        while (total_to_write)
+    const uint8_t * p = static_cast<const uint8_t*>(data);
+    size_t total_to_write = data_sz;
+
+    while (total_to_write)
+    {
+        if (cur_page->sz >= cur_page->capacity)
         {
-            if (cur_page->sz >= cur_page->page_size())
+            if (can_expand)
             {
-                if (cur_page->can_expand)
-                {
-                    cur_page->insert_page();
-                    cur_page = cur_page->next;
-                    cur_page->set_expand(true);
-                }
-                else
-                {
-                    return data_sz - total_to_write;
-                }
+                insert_page(cur_page);
+                cur_page = cur_page->next;
             }
+            else
+            {
+                break;
+            }
+        }
 
-            size_t to_write = min<size_t>(data_sz, cur_page->page_size() - cur_page->sz);
-
-            memcpy(cur_page->page + cur_page->sz, p, to_write);
-            p += to_write;
-            data_sz -= to_write;
+        size_t to_write = min<size_t>(total_to_write, cur_page->capacity - cur_page->sz);
 
-            total_to_write -= to_write;
-            cur_page->sz += to_write;
-        }
+        memcpy(cur_page->data + cur_page->sz, p, to_write);
+        p += to_write;
 
-        return data_sz;
+        total_to_write -= to_write;
+        cur_page->sz += to_write;
     }
+
+    return data_sz - total_to_write;
 }
 
-template<int data_size>
-inline void mem_chunk<data_size>::print()
+inline void mem_chunk::print()
 {
     int ch_n = 0;
-    mem_chunk<data_size> * cur_page = this;
+    page_t * cur_page = head;
     while (cur_page)
     {
         char u[1024];
         memset(u, 0, 1024);
 
-        memcpy(u, cur_page->page, cur_page->sz);
+        memcpy(u, cur_page->data, min<size_t>(cur_page->sz, 1023));
 
-        slogger.debug("mem_chunk[#%d](mr:%d,sz:%d)'%s'", ch_n, cur_page->current, cur_page->sz, u);
+        slogger.debug("mem_chunk[#%d](mr:%d,sz:%d)'%s'", ch_n, (int)cur_page->current, (int)cur_page->sz, u);
 
         cur_page = cur_page->next;
 
@@ -177,24 +220,30 @@ inline void mem_chunk<data_size>::print()
     }
 }
 
-template<int data_size>
-inline bool mem_chunk<data_size>::write_to_fd(int fd, bool& can_write, bool& want_write, bool& wreof)
+inline bool mem_chunk::write_to_fd(int fd, bool& can_write, bool& want_write, bool& wreof)
 {
     bool iswr = false;
 
-    mem_chunk<data_size> * cur_page = this;
+    page_t * cur_page = head;
+
+    if (0 == cur_page)
+    {
+        want_write = false;
+
+        return false;
+    }
 
-    while (cur_page->next && (cur_page->current == cur_page->get_data_size()))
+    while (cur_page->next && (cur_page->current == cur_page->sz))
     {
         cur_page = cur_page->next;
     }
 
     while (true)
     {
-        ssize_t to_write = cur_page->get_data_size() - cur_page->current;
+        ssize_t to_write = cur_page->sz - cur_page->current;
         if (to_write)
         {
-            ssize_t wr = write(fd, cur_page->page + cur_page->current, to_write);
+            ssize_t wr = write(fd, cur_page->data + cur_page->current, to_write);
             if (-1 == wr)
             {
                 //slogger.debug("process/read error: '%s'", print_errno().c_str());
@@ -287,24 +336,29 @@ inline bool mem_chunk<data_size>::write_to_fd(int fd, bool& can_write, bool& wan
     }
 }
 
-template<int data_size>
-inline bool mem_chunk<data_size>::read_from_fd(int fd, bool& can_read, bool& want_read, bool& rdeof)
+inline bool mem_chunk::read_from_fd(int fd, bool& can_read, bool& want_read, bool& rdeof)
 {
-    mem_chunk<data_size> * cur_page = this;
+    // the first page is taken when there is something to read
+    if (0 == head)
+    {
+        head = new_page();
+    }
+
+    page_t * cur_page = head;
 
     bool failed = true;
 
-    while (cur_page->next && (cur_page->page_size() == cur_page->get_data_size()))
+    while (cur_page->next && (cur_page->capacity == cur_page->sz))
     {
         cur_page = cur_page->next;
     }
 
     while (true)
     {
-        const ssize_t to_read = cur_page->page_size() - cur_page->get_data_size();
+        const ssize_t to_read = cur_page->capacity - cur_page->sz;
         if (to_read)
         {
-            const ssize_t    rd = read(fd, cur_page->page + cur_page->get_data_size(), to_read);
+            const ssize_t    rd = read(fd, cur_page->data + cur_page->sz, to_read);
             if (-1 == rd)
             {
                 //slogger.debug("process/read error: '%s'", print_errno().c_str());
@@ -348,7 +402,7 @@ inline bool mem_chunk<data_size>::read_from_fd(int fd, bool& can_read, bool& wan
         }
         else if (can_expand)
         {
-            insert_page();
+            insert_page(cur_page);
         }
         else if (failed)
         {
@@ -369,7 +423,8 @@ inline bool mem_chunk<data_size>::read_from_fd(int fd, bool& can_read, bool& wan
 
 //-------------------------------------------------------------------------------------------------------------------
 
-inline mem_block::mem_block(size_t sz) : page(0), page_capacity(0), page_sz(0), current(0)
+inline mem_block::mem_block(size_t sz) : page(0), page_capacity(0), page_sz(0), current(0), file_fd(-1), mapped(false),
+    account(-1)
 {
     resize(sz);
 }
@@ -406,9 +461,25 @@ inline size_t& mem_block::marker()
 
 inline void mem_block::resize(size_t sz)
 {
-    if (page)
+    if (-1 != file_fd)
+    {
+        if (mapped)
+        {
+            munmap(page, page_sz);
+        }
+
+        close(file_fd);
+
+        file_fd = -1;
+        mapped = false;
+
+        page = 0;
+        page_capacity = 0;
+    }
+    else if (page)
     {
         delete[] page;
+        mem_account.sub(account, page_capacity);
 
         page = 0;
         page_capacity = 0;
@@ -418,12 +489,98 @@ inline void mem_block::resize(size_t sz)
     {
         page = new uint8_t[sz];
         page_capacity = sz;
+
+        mem_account.add(account, sz);
     }
 
     page_sz = 0;
     current = 0;
 }
 
+inline bool mem_block::resize_to_file(size_t sz, const char * dir)
+{
+    resize(0);
+
+#ifdef O_TMPFILE
+    file_fd = open(dir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+
+    if (-1 == file_fd)
+    {
+        // no O_TMPFILE here or for this file system
+        std::string tmpl = std::string(dir) + "/lizard-body-XXXXXX";
+
+        file_fd = mkstemp(&tmpl[0]);
+        if (-1 == file_fd)
+        {
+            slogger.error("block/file: can't create a temporary file in %s: %s", dir, strerror(errno));
+            return false;
+        }
+
+        unlink(tmpl.c_str());
+    }
+
+    page_capacity = sz;
+
+    return true;
+}
+
+inline void mem_block::set_account(int category)
+{
+    account = category;
+}
+
+inline bool mem_block::in_file()const
+{
+    return -1 != file_fd;
+}
+
+inline bool mem_block::seal()
+{
+    if (-1 == file_fd || mapped || 0 == page_sz)
+    {
+        return true;
+    }
+
+    void * m = mmap(0, page_sz, PROT_READ, MAP_SHARED, file_fd, 0);
+    if (MAP_FAILED == m)
+    {
+        slogger.error("block/file: can't map %d bytes: %s", (int)page_sz, strerror(errno));
+        return false;
+    }
+
+    page = (uint8_t *)m;
+    mapped = true;
+
+    return true;
+}
+
+inline bool mem_block::write_to_file(const void * data, size_t data_sz)
+{
+    const uint8_t * p = (const uint8_t *)data;
+
+    while (data_sz)
+    {
+        ssize_t wr = write(file_fd, p, data_sz);
+        if (-1 == wr)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            slogger.error("block/file write error: %s", strerror(errno));
+            return false;
+        }
+
+        p += wr;
+        data_sz -= wr;
+        page_sz += wr;
+    }
+
+    return true;
+}
+
 inline void mem_block::reset()
 {
     page_sz = 0;
@@ -445,6 +602,15 @@ inline void mem_block::print()
 inline size_t mem_block::append_data(const void * data, size_t data_sz)
 {
     size_t to_write = min<size_t>(data_sz, capacity() - size());
+
+    if (-1 != file_fd)
+    {
+        size_t before = size();
+        write_to_file(data, to_write);
+
+        return size() - before;
+    }
+
     memcpy(page + size(), data, to_write);
     page_sz += to_write;
 
@@ -518,8 +684,62 @@ inline bool mem_block::write_to_fd(int fd, bool& can_write, bool& want_write, bo
     }
 }
 
+inline bool mem_block::read_to_file(int fd, bool& can_read, bool& want_read, bool& rdeof)
+{
+    enum {FILE_READ_SZ = 65536};
+
+    uint8_t buff[FILE_READ_SZ];
+
+    while (size() < capacity())
+    {
+        const ssize_t to_read = min<size_t>(capacity() - size(), FILE_READ_SZ);
+        const ssize_t rd = read(fd, buff, to_read);
+
+        if (-1 == rd)
+        {
+            if (EAGAIN == errno)
+            {
+                can_read = false;
+                return false;
+            }
+            else if (EINTR != errno)
+            {
+                slogger.error("block/read error: %s", strerror(errno));
+                can_read = false;
+                return false;
+            }
+        }
+        else if (0 == rd)
+        {
+            slogger.debug("block/read: got EOF");
+
+            can_read = false;
+            rdeof = true;
+
+            return false;
+        }
+        else if (!write_to_file(buff, rd))
+        {
+            // the body can't be stored, treat it like a broken connection
+            can_read = false;
+            rdeof = true;
+
+            return false;
+        }
+    }
+
+    want_read = false;
+
+    return true;
+}
+
 inline bool mem_block::read_from_fd(int fd, bool& can_read, bool& want_read, bool& rdeof)
 {
+    if (-1 != file_fd)
+    {
+        return read_to_file(fd, can_read, want_read, rdeof);
+    }
+
     while (true)
     {
         const ssize_t to_read = capacity() - size();
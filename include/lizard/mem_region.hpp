@@ -0,0 +1,114 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_MEM_REGION_HPP__
+#define __LIZARD_MEM_REGION_HPP__
+
+#include <lizard/pool/pool.hpp>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Fixed size blocks carved from one large mmap()ed region.
+
+The region is backed by huge pages: hugetlbfs pages when asked for and
+reserved by the system, transparent huge pages (MADV_HUGEPAGE) otherwise. It
+may prefer the memory of one NUMA node and may be touched in advance so that
+no page faults happen under load. When the region is used up, blocks come
+from malloc(). A returned block is kept for reuse; with transparent huge
+pages the whole huge pages it covers go back to the system until the block
+is used again; a block smaller than a huge page keeps its memory.
+
+*/
+class mem_region : public pool_ns::page_source
+{
+public:
+    enum huge_mode {hugeOff, hugeTransparent, hugeTLB};
+
+    struct region_stats
+    {
+        int mode;          // huge_mode actually in use
+
+        size_t block_size;
+        size_t blocks;     // in the region
+        size_t used;       // taken from the region
+
+        uint64_t fallbacks; // malloc()ed because the region was used up
+    };
+
+private:
+
+    uint8_t * base;
+    size_t    length;
+
+    size_t    block_sz;
+    size_t    blocks_num;
+    size_t    next_block;  // never used yet
+    size_t    page_sz;     // huge page size of the region
+
+    size_t    blocks_req;  // as asked by init()
+    int       huge_req;
+
+    int       mode;
+
+    std::vector<void *> free_blocks;
+
+    uint64_t  fallbacks;
+
+    mutable pthread_mutex_t mutex;
+
+    mem_region(const mem_region&);
+    mem_region& operator=(const mem_region&);
+
+    void unmap();
+
+public:
+
+    mem_region();
+    ~mem_region();
+
+    // node -1 keeps the default memory policy; false if nothing could be mapped
+    // (allocations then go to malloc). A mapped region is never mapped anew:
+    // its blocks may be in use, later calls keep it and return true
+    bool init(size_t block_size, size_t blocks, huge_mode huge, int node, bool prefault);
+
+    static huge_mode parse_mode(const std::string& str);
+    static const char * mode_name(int mode);
+
+    bool mapped()const;
+    bool owns(const void * ptr)const;
+
+    // blocks of any other size always come from malloc
+    void * allocate(size_t sz);
+    void free(void * ptr, size_t sz);
+
+    // all blocks the region has, in no particular order; for pools that take
+    // the region whole at start
+    void take_all(std::vector<void *>& res);
+
+    void get_stats(region_stats& res)const;
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
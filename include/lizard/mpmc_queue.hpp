@@ -0,0 +1,186 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_MPMC_QUEUE_HPP__
+#define __LIZARD_MPMC_QUEUE_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lizard
+{
+
+enum {CACHE_LINE_SZ = 64};
+
+inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+//-----------------------------------------------------------------
+
+/*
+
+Bounded lock-free multi-producer/multi-consumer queue (D. Vyukov).
+
+Every cell carries a sequence number which tells whether the cell is ready
+for the producer (seq == pos) or for the consumer (seq == pos + 1), so push
+and pop cost one CAS on their own index and never touch the other side's
+cache line. Capacity is rounded up to a power of two.
+
+*/
+template <typename T>
+class mpmc_queue
+{
+    struct cell
+    {
+        size_t seq;
+        T data;
+    };
+
+    char   pad0[CACHE_LINE_SZ];
+
+    cell * buffer;
+    size_t mask;
+
+    char   pad1[CACHE_LINE_SZ];
+
+    size_t enqueue_pos;
+
+    char   pad2[CACHE_LINE_SZ];
+
+    size_t dequeue_pos;
+
+    char   pad3[CACHE_LINE_SZ];
+
+    mpmc_queue(const mpmc_queue&);
+    mpmc_queue& operator=(const mpmc_queue&);
+
+public:
+
+    explicit mpmc_queue(size_t capacity) : buffer(0), mask(0), enqueue_pos(0), dequeue_pos(0)
+    {
+        size_t sz = 2;
+        while (sz < capacity)
+        {
+            sz <<= 1;
+        }
+
+        buffer = new cell[sz];
+        mask = sz - 1;
+
+        for (size_t i = 0; i < sz; i++)
+        {
+            buffer[i].seq = i;
+        }
+    }
+
+    ~mpmc_queue()
+    {
+        delete[] buffer;
+    }
+
+    size_t capacity()const
+    {
+        return mask + 1;
+    }
+
+    bool push(const T& data)
+    {
+        cell * c;
+        size_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+        while (true)
+        {
+            c = buffer + (pos & mask);
+
+            size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+            if (0 == dif)
+            {
+                if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        c->data = data;
+        __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    bool pop(T& data)
+    {
+        cell * c;
+        size_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+
+        while (true)
+        {
+            c = buffer + (pos & mask);
+
+            size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+            if (0 == dif)
+            {
+                if (__atomic_compare_exchange_n(&dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        data = c->data;
+        __atomic_store_n(&c->seq, pos + mask + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // approximate: exact only when nobody is pushing or popping
+    size_t size()const
+    {
+        size_t tail = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        size_t head = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+
+        return tail > head ? tail - head : 0;
+    }
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
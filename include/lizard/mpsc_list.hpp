@@ -0,0 +1,108 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_MPSC_LIST_HPP__
+#define __LIZARD_MPSC_LIST_HPP__
+
+#include <stddef.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+struct mpsc_node
+{
+    mpsc_node * mpsc_next;
+
+    mpsc_node() : mpsc_next(0){}
+};
+
+/*
+
+Intrusive unbounded multi-producer/single-consumer list.
+
+Producers push onto a Treiber stack with one CAS, the consumer takes the
+whole stack with one exchange and reverses it, so a batch comes out in push
+order. Elements derive from mpsc_node and must not be in the list twice.
+
+*/
+template <typename T>
+class mpsc_list
+{
+    mpsc_node * head;
+
+    mpsc_list(const mpsc_list&);
+    mpsc_list& operator=(const mpsc_list&);
+
+public:
+
+    mpsc_list() : head(0){}
+
+    // returns true if the list was empty
+    bool push(T * el)
+    {
+        mpsc_node * node = el;
+        mpsc_node * h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+        do
+        {
+            node->mpsc_next = h;
+        }
+        while (!__atomic_compare_exchange_n(&head, &h, node, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+        return 0 == h;
+    }
+
+    bool empty()const
+    {
+        return 0 == __atomic_load_n(&head, __ATOMIC_SEQ_CST);
+    }
+
+    // takes all elements, the oldest comes first; 'num' receives their count
+    T * pop_all(size_t * num = 0)
+    {
+        mpsc_node * h = __atomic_exchange_n(&head, (mpsc_node *)0, __ATOMIC_ACQUIRE);
+        mpsc_node * res = 0;
+
+        size_t n = 0;
+
+        while (h)
+        {
+            mpsc_node * next = h->mpsc_next;
+
+            h->mpsc_next = res;
+            res = h;
+            h = next;
+
+            n++;
+        }
+
+        if (num)
+        {
+            *num = n;
+        }
+
+        return static_cast<T *>(res);
+    }
+
+    static T * next(T * el)
+    {
+        return static_cast<T *>(static_cast<mpsc_node *>(el)->mpsc_next);
+    }
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
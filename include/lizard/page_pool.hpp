@@ -0,0 +1,126 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_PAGE_POOL_HPP__
+#define __LIZARD_PAGE_POOL_HPP__
+
+#include <lizard/mem_region.hpp>
+#include <lizard/mpmc_queue.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Recycles the extra pages of mem_chunk chains between requests.
+
+Pages fall into a few size classes (1 KB .. 64 KB payload plus room for the
+chunk header); every class keeps up to 'retain' free pages in a bounded
+lock-free ring, so any thread may return a page another thread took. A page
+is malloc()ed when its ring is empty and free()d when the ring is full;
+bigger blocks always go to malloc. Until init() (and with retain 0) the pool
+only counts.
+
+With huge pages the retained pages of every class are carved from a
+mem_region at init() and stay in the ring for good; pages malloc()ed when the
+ring runs dry are free()d on return. Once mapped, the regions and their rings
+outlive restarts: init() keeps them, since connections may hold their pages.
+
+*/
+class page_pool
+{
+public:
+    enum {CLASSES_NUM = 7};
+    enum {MIN_CLASS_SHIFT = 10};
+    enum {HEADER_SLACK = 64};
+
+    struct class_stats
+    {
+        size_t size;
+        size_t retained;
+
+        uint64_t hits;   // served from the ring
+        uint64_t misses; // malloc()ed
+        uint64_t drops;  // free()d because the ring was full
+
+        size_t region_pages; // carved from the huge page region
+    };
+
+private:
+
+    struct size_class
+    {
+        mpmc_queue<void *> * free_pages;
+
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t drops;
+
+        char pad[CACHE_LINE_SZ];
+
+        size_class() : free_pages(0), hits(0), misses(0), drops(0){}
+    };
+
+    size_class classes[CLASSES_NUM];
+
+    mem_region regions[CLASSES_NUM];
+    int huge;
+
+    size_t retain_num; // as asked by init()
+    int huge_req;
+
+    uint64_t large_allocs;
+
+    page_pool(const page_pool&);
+    page_pool& operator=(const page_pool&);
+
+    static int class_of(size_t sz);
+
+    void drain();
+
+public:
+
+    page_pool();
+    ~page_pool();
+
+    // must be called while no other thread uses the pool; node -1 keeps the
+    // default memory policy
+    void init(size_t retain, mem_region::huge_mode huge_pages = mem_region::hugeOff, int node = -1, bool prefault = false);
+
+    static size_t class_size(int cl);
+
+    // puts up to 'pages' touched pages of the class of 'sz' to its ring;
+    // returns the number of pages added
+    size_t warm_up(size_t sz, size_t pages);
+
+    void * allocate(size_t sz);
+    void free(void * ptr, size_t sz);
+
+    // page allocations of any size, served or not
+    uint64_t get_allocs()const;
+
+    void get_stats(class_stats * res)const; // CLASSES_NUM elements
+
+    int huge_mode()const;
+};
+
+//-----------------------------------------------------------------
+}
+
+extern lizard::page_pool mem_pages;
+
+#endif
@@ -17,7 +17,10 @@
 
 #include <arpa/inet.h>
 #include <cstdarg>
+#include <new>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <utils/error.hpp>
 
@@ -26,12 +29,81 @@ namespace lizard
 
 //-----------------------------------------------------------------
 
+// bytes of a request with their length, valid as long as the request; the
+// data may hold zero bytes
+struct string_view
+{
+    const char * data; // 0 if there is no such part
+    size_t       size;
+
+    string_view() : data(0), size(0){}
+    string_view(const char * d, size_t sz) : data(d), size(sz){}
+    string_view(const char * s) : data(s), size(s ? strlen(s) : 0){}
+
+    bool empty()const { return 0 == size; }
+};
+
+// decoded key-value pairs of a query string or a form
+struct request_params
+{
+    struct item
+    {
+        string_view key;   // NUL-terminated as well
+        string_view value;
+    };
+
+    const item * items;
+    size_t       num;
+
+    request_params() : items(0), num(0){}
+
+    size_t size()const { return num; }
+    const item& operator[](size_t i)const { return items[i]; }
+
+    // the value of the first equal key, data is 0 if there is none
+    string_view get(const string_view& key)const
+    {
+        for (size_t i = 0; i < num; i++)
+        {
+            if (items[i].key.size == key.size && !memcmp(items[i].key.data, key.data, key.size))
+            {
+                return items[i].value;
+            }
+        }
+
+        return string_view();
+    }
+};
+
 class task
 {
 public:
 
     enum request_method_t {requestUNDEF, requestGET, requestPOST, requestHEAD};
 
+    // headers found without a key lookup
+    enum request_header_t
+    {
+        headerHost,
+        headerCookie,
+        headerContentType,
+        headerContentLength,
+        headerConnection,
+        headerUserAgent,
+        headerAccept,
+        headerAcceptEncoding,
+        headerAcceptLanguage,
+        headerReferer,
+        headerExpect,
+        headerXForwardedFor,
+        headerXRealIP,
+        headerIfModifiedSince,
+        headerAuthorization,
+        headerRange,
+
+        KNOWN_HEADERS_NUM
+    };
+
 
     virtual ~task(){};
     virtual request_method_t get_request_method()const = 0;
@@ -50,18 +122,107 @@ public:
     virtual const uint8_t *  get_request_body()const = 0;
 
     virtual const char *     get_request_header(const char *)const = 0;
+    virtual const char *     get_request_header(request_header_t)const = 0;
     virtual size_t           get_request_headers_num()const = 0;
     virtual const char *     get_request_header_key(int)const = 0;
     virtual const char *     get_request_header_value(int)const = 0;
 
+    // the same parts without strlen(), straight from the parser
+    virtual string_view      get_request_uri_path_view()const = 0;
+    virtual string_view      get_request_uri_params_view()const = 0;
+    virtual string_view      get_request_header_view(const string_view& key)const = 0;
+    virtual string_view      get_request_header_view(request_header_t)const = 0;
+    virtual string_view      get_request_header_key_view(int)const = 0;
+    virtual string_view      get_request_header_value_view(int)const = 0;
+
+    // the query string and an application/x-www-form-urlencoded body, split
+    // and decoded on the first call and kept in the request memory
+    virtual const request_params& get_request_query() = 0;
+    virtual const request_params& get_request_form() = 0;
+
 
     virtual void set_response_status(int) = 0;
     virtual void set_keepalive(bool) = 0;
     virtual void set_cache(bool) = 0;
     virtual void set_response_header(const char * header_nm, const char * val) = 0;
     virtual void append_response_body(const char * data, size_t sz) = 0;
+
+    // memory of the request: valid until the response is sent, freed all at
+    // once; align is a power of two. 0 if there is no memory
+    virtual void * alloc(size_t sz, size_t align = sizeof(void *)) = 0;
 };
 
+/*
+
+STL allocator over task::alloc(), for containers that live no longer than
+the request:
+
+    std::vector<int, lizard::arena_allocator<int> > v((lizard::arena_allocator<int>(tsk)));
+
+deallocate() does nothing, the memory goes away with the request.
+
+*/
+template <typename T>
+class arena_allocator
+{
+    task * tsk;
+
+public:
+    typedef T              value_type;
+    typedef T *            pointer;
+    typedef const T *      const_pointer;
+    typedef T &            reference;
+    typedef const T &      const_reference;
+    typedef size_t         size_type;
+    typedef ptrdiff_t      difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef arena_allocator<U> other;
+    };
+
+    explicit arena_allocator(task * t) : tsk(t){}
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other) : tsk(other.get_task()){}
+
+    pointer allocate(size_type n, const void * = 0)
+    {
+        void * p = tsk->alloc(n * sizeof(T), __alignof__(T));
+        if (0 == p)
+        {
+            throw std::bad_alloc();
+        }
+
+        return (pointer)p;
+    }
+
+    void deallocate(pointer, size_type){}
+
+    void construct(pointer p, const T& val){new ((void *)p) T(val);}
+    void destroy(pointer p){p->~T();}
+
+    size_type max_size()const{return (size_type)-1 / sizeof(T);}
+
+    pointer address(reference x)const{return &x;}
+    const_pointer address(const_reference x)const{return &x;}
+
+    task * get_task()const{return tsk;}
+};
+
+template <typename T, typename U>
+inline bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.get_task() == b.get_task();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.get_task() != b.get_task();
+}
+
 enum plugin_log_levels
 {
     log_access = 0,  /* special level for access log       */
@@ -83,13 +244,36 @@ public:
 
     virtual void  log_message(plugin_log_levels log_level, const char * param_str, ...) LZ_FORMAT(printf, 3, 4) = 0;
     virtual void vlog_message(plugin_log_levels log_level, const char * param_str, va_list ap) = 0;
+
+    // Hands back a task the plugin kept by returning plugin::rAsync.
+    // rSuccess/rError - the response is ready (rError answers 503),
+    // rHard - the task goes to a hard thread; false if the hard queue is full
+    // or there are no hard threads, the task then stays with the caller.
+    // May be called from any thread.
+    virtual bool complete_task(lizard::task * tsk, int result) = 0;
+
+    // Calls cb(arg, events) once on the epoll thread when fd gets any of
+    // 'events' (EPOLLIN, EPOLLOUT, ...); EPOLLERR/EPOLLHUP are always reported.
+    // The fd is out of the epoll set when cb runs. May be called from any thread.
+    virtual bool watch_fd(int fd, uint32_t events, void (*cb)(void * arg, uint32_t events), void * arg) = 0;
+
+    // Calls cb(arg) once after 'ms' milliseconds / every 'ms' milliseconds on a
+    // timer thread (see <timer_threads>); long callbacks delay other timers.
+    // Return the timer id, 0 on error. All timers are dropped on restart.
+    // May be called from any thread.
+    virtual uint64_t schedule_after(uint32_t ms, void (*cb)(void * arg), void * arg) = 0;
+    virtual uint64_t schedule_every(uint32_t ms, void (*cb)(void * arg), void * arg) = 0;
+
+    // false if the timer has already fired or is unknown; a running callback is not waited for
+    virtual bool cancel_timer(uint64_t id) = 0;
 };
 
 
 class plugin
 {
 public:
-    enum {rSuccess, rHard, rError};
+    // rAsync - the plugin keeps the task and hands it back with server_callback::complete_task()
+    enum {rSuccess, rHard, rError, rAsync};
 
     plugin(server_callback* /*srv*/){}
     virtual ~plugin(){}
@@ -101,6 +285,10 @@ public:
 
     virtual void idle(){}
 
+    // called once before the server starts to listen, after the connection
+    // and buffer pools are warmed up
+    virtual void warmup(){}
+
     virtual const char* version_string() const = 0;
 };
 //-----------------------------------------------------------------
@@ -0,0 +1,153 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __POOL_MAGAZINE_POOL_HPP__
+#define __POOL_MAGAZINE_POOL_HPP__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "pool.hpp"
+
+namespace pool_ns
+{
+
+/*
+
+Fixed size object allocator with per-thread caches (magazines).
+
+Every thread keeps two magazines of up to magazine_size free objects and
+allocates and frees from them without locking. Only when both are empty (or
+both full) does it exchange a whole magazine with the shared depot under a
+mutex; the depot refills from a plain pool. An object may be freed by any
+thread, it goes to that thread's cache.
+
+trim() gives the full magazines of a depot that saw no exchange for the idle
+period back to the pool and lets the pool release its idle free pages.
+
+*/
+template <typename T, int objects_per_page = 65536, int magazine_size = 64>
+class magazine_pool
+{
+public:
+
+    typedef typename pool<T, objects_per_page>::occupancy_stats occupancy_stats;
+
+    struct cache_stats
+    {
+        std::string thread;  // thread name
+
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t depot_gets; // magazine exchanges with the depot
+        uint64_t depot_puts;
+
+        size_t cached;       // free objects in this thread's magazines
+    };
+
+private:
+
+    struct magazine
+    {
+        int num;
+        T * objects[magazine_size];
+
+        magazine() : num(0){}
+
+        bool empty()const{return 0 == num;}
+        bool full()const{return magazine_size == num;}
+    };
+
+    struct cache
+    {
+        magazine_pool * owner;
+
+        magazine * loaded;
+        magazine * previous;
+
+        // written by the owning thread, read by stats
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t depot_gets;
+        uint64_t depot_puts;
+        size_t cached;
+
+        char thread[16];
+
+        cache(magazine_pool * o);
+    };
+
+    pool<T, objects_per_page> base;
+
+    mutable pthread_mutex_t depot_mutex;
+
+    std::vector<magazine *> full_magazines;
+    std::vector<magazine *> empty_magazines;
+
+    std::vector<cache *> caches;
+
+    // totals of the caches of exited threads
+    uint64_t retired_allocs;
+    uint64_t retired_frees;
+
+    uint64_t depot_ops;          // magazine exchanges, for trim()
+    uint64_t depot_ops_seen;
+    uint64_t depot_idle_since;
+
+    pthread_key_t cache_key;
+
+    magazine_pool(const magazine_pool&);
+    magazine_pool& operator=(const magazine_pool&);
+
+    cache * get_cache();
+
+    void exchange_for_full(cache * c);
+    void exchange_for_empty(cache * c);
+
+    void return_magazine(magazine * m);
+
+    static void release_cache(void * ptr);
+
+public:
+    magazine_pool();
+    ~magazine_pool();
+
+    T * allocate();
+    void free(T * elem);
+
+    u_int32_t allocated_pages()const;
+    u_int32_t allocated_objects()const; // in use, cached objects are not counted
+
+    size_t depot_magazines()const;
+
+    void set_page_source(page_source * src);
+
+    // see pool::reserve()
+    u_int32_t reserve(u_int32_t objects);
+
+    // called periodically by one thread; returns the number of released pages
+    u_int32_t trim(uint64_t now, uint64_t idle_time);
+
+    void get_occupancy(occupancy_stats& res)const;
+
+    void get_cache_stats(std::vector<cache_stats>& res)const;
+};
+
+#include "magazine_pool.tcc"
+
+}
+
+#endif //__POOL_MAGAZINE_POOL_HPP__
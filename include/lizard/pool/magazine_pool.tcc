@@ -0,0 +1,355 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+template <typename T, int objects_per_page, int magazine_size>
+inline magazine_pool<T, objects_per_page, magazine_size>::cache::cache(magazine_pool * o) : owner(o), loaded(new magazine), previous(new magazine),
+    allocs(0), frees(0), depot_gets(0), depot_puts(0), cached(0)
+{
+    thread[0] = 0;
+    pthread_getname_np(pthread_self(), thread, sizeof(thread));
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline magazine_pool<T, objects_per_page, magazine_size>::magazine_pool() : retired_allocs(0), retired_frees(0),
+    depot_ops(0), depot_ops_seen(0), depot_idle_since(0)
+{
+    pthread_mutex_init(&depot_mutex, 0);
+    pthread_key_create(&cache_key, &release_cache);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline magazine_pool<T, objects_per_page, magazine_size>::~magazine_pool()
+{
+    // no destructor may run for the caches of still living threads after this
+    pthread_key_delete(cache_key);
+
+    for(size_t i = 0; i < caches.size(); i++)
+    {
+        delete caches[i]->loaded;
+        delete caches[i]->previous;
+        delete caches[i];
+    }
+
+    for(size_t i = 0; i < full_magazines.size(); i++)
+    {
+        delete full_magazines[i];
+    }
+
+    for(size_t i = 0; i < empty_magazines.size(); i++)
+    {
+        delete empty_magazines[i];
+    }
+
+    pthread_mutex_destroy(&depot_mutex);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline typename magazine_pool<T, objects_per_page, magazine_size>::cache * magazine_pool<T, objects_per_page, magazine_size>::get_cache()
+{
+    cache * c = (cache *)pthread_getspecific(cache_key);
+
+    if(0 == c)
+    {
+        c = new cache(this);
+
+        pthread_mutex_lock(&depot_mutex);
+        caches.push_back(c);
+        pthread_mutex_unlock(&depot_mutex);
+
+        pthread_setspecific(cache_key, c);
+    }
+
+    return c;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::return_magazine(magazine * m)
+{
+    // depot_mutex is held
+    if(m->full())
+    {
+        full_magazines.push_back(m);
+    }
+    else
+    {
+        while(!m->empty())
+        {
+            base.free(m->objects[--m->num]);
+        }
+
+        empty_magazines.push_back(m);
+    }
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::release_cache(void * ptr)
+{
+    cache * c = (cache *)ptr;
+    magazine_pool * p = c->owner;
+
+    pthread_mutex_lock(&p->depot_mutex);
+
+    p->return_magazine(c->loaded);
+    p->return_magazine(c->previous);
+
+    p->retired_allocs += c->allocs;
+    p->retired_frees += c->frees;
+
+    for(size_t i = 0; i < p->caches.size(); i++)
+    {
+        if(p->caches[i] == c)
+        {
+            p->caches.erase(p->caches.begin() + i);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&p->depot_mutex);
+
+    delete c;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::exchange_for_full(cache * c)
+{
+    // both magazines are empty: trade one for a full one from the depot, or fill it from the pages
+    pthread_mutex_lock(&depot_mutex);
+
+    if(!full_magazines.empty())
+    {
+        empty_magazines.push_back(c->loaded);
+
+        c->loaded = full_magazines.back();
+        full_magazines.pop_back();
+    }
+    else
+    {
+        while(!c->loaded->full())
+        {
+            c->loaded->objects[c->loaded->num++] = base.allocate();
+        }
+    }
+
+    depot_ops++;
+
+    pthread_mutex_unlock(&depot_mutex);
+
+    __atomic_store_n(&c->depot_gets, c->depot_gets + 1, __ATOMIC_RELAXED);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::exchange_for_empty(cache * c)
+{
+    // both magazines are full: hand one over to the depot
+    pthread_mutex_lock(&depot_mutex);
+
+    full_magazines.push_back(c->loaded);
+
+    if(!empty_magazines.empty())
+    {
+        c->loaded = empty_magazines.back();
+        empty_magazines.pop_back();
+    }
+    else
+    {
+        c->loaded = 0;
+    }
+
+    depot_ops++;
+
+    pthread_mutex_unlock(&depot_mutex);
+
+    if(0 == c->loaded)
+    {
+        c->loaded = new magazine;
+    }
+
+    __atomic_store_n(&c->depot_puts, c->depot_puts + 1, __ATOMIC_RELAXED);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline T * magazine_pool<T, objects_per_page, magazine_size>::allocate()
+{
+    cache * c = get_cache();
+
+    if(c->loaded->empty())
+    {
+        if(!c->previous->empty())
+        {
+            magazine * m = c->loaded;
+            c->loaded = c->previous;
+            c->previous = m;
+        }
+        else
+        {
+            exchange_for_full(c);
+        }
+    }
+
+    T * ret = c->loaded->objects[--c->loaded->num];
+
+    __atomic_store_n(&c->allocs, c->allocs + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->cached, (size_t)(c->loaded->num + c->previous->num), __ATOMIC_RELAXED);
+
+    return ret;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::free(T * elem)
+{
+    cache * c = get_cache();
+
+    if(c->loaded->full())
+    {
+        if(!c->previous->full())
+        {
+            magazine * m = c->loaded;
+            c->loaded = c->previous;
+            c->previous = m;
+        }
+        else
+        {
+            exchange_for_empty(c);
+        }
+    }
+
+    c->loaded->objects[c->loaded->num++] = elem;
+
+    __atomic_store_n(&c->frees, c->frees + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->cached, (size_t)(c->loaded->num + c->previous->num), __ATOMIC_RELAXED);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline u_int32_t magazine_pool<T, objects_per_page, magazine_size>::allocated_pages()const
+{
+    pthread_mutex_lock(&depot_mutex);
+    u_int32_t res = base.allocated_pages();
+    pthread_mutex_unlock(&depot_mutex);
+
+    return res;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline u_int32_t magazine_pool<T, objects_per_page, magazine_size>::allocated_objects()const
+{
+    pthread_mutex_lock(&depot_mutex);
+
+    uint64_t allocs = retired_allocs;
+    uint64_t frees = retired_frees;
+
+    for(size_t i = 0; i < caches.size(); i++)
+    {
+        allocs += __atomic_load_n(&caches[i]->allocs, __ATOMIC_RELAXED);
+        frees += __atomic_load_n(&caches[i]->frees, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&depot_mutex);
+
+    return allocs > frees ? (u_int32_t)(allocs - frees) : 0;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline size_t magazine_pool<T, objects_per_page, magazine_size>::depot_magazines()const
+{
+    pthread_mutex_lock(&depot_mutex);
+    size_t res = full_magazines.size();
+    pthread_mutex_unlock(&depot_mutex);
+
+    return res;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::get_cache_stats(std::vector<cache_stats>& res)const
+{
+    pthread_mutex_lock(&depot_mutex);
+
+    res.resize(caches.size());
+
+    for(size_t i = 0; i < caches.size(); i++)
+    {
+        const cache * c = caches[i];
+        cache_stats& s = res[i];
+
+        s.thread = c->thread;
+
+        s.allocs = __atomic_load_n(&c->allocs, __ATOMIC_RELAXED);
+        s.frees = __atomic_load_n(&c->frees, __ATOMIC_RELAXED);
+        s.depot_gets = __atomic_load_n(&c->depot_gets, __ATOMIC_RELAXED);
+        s.depot_puts = __atomic_load_n(&c->depot_puts, __ATOMIC_RELAXED);
+        s.cached = __atomic_load_n(&c->cached, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&depot_mutex);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline u_int32_t magazine_pool<T, objects_per_page, magazine_size>::reserve(u_int32_t objects)
+{
+    pthread_mutex_lock(&depot_mutex);
+    u_int32_t res = base.reserve(objects);
+    pthread_mutex_unlock(&depot_mutex);
+
+    return res;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline u_int32_t magazine_pool<T, objects_per_page, magazine_size>::trim(uint64_t now, uint64_t idle_time)
+{
+    pthread_mutex_lock(&depot_mutex);
+
+    if(depot_ops != depot_ops_seen || 0 == depot_idle_since)
+    {
+        depot_ops_seen = depot_ops;
+        depot_idle_since = now ? now : 1;
+    }
+    else if(now - depot_idle_since >= idle_time)
+    {
+        // nobody needed the cached objects for a while, they may hold pages
+        for(size_t i = 0; i < full_magazines.size(); i++)
+        {
+            magazine * m = full_magazines[i];
+
+            while(!m->empty())
+            {
+                base.free(m->objects[--m->num]);
+            }
+
+            empty_magazines.push_back(m);
+        }
+
+        full_magazines.clear();
+    }
+
+    u_int32_t res = base.trim(now, idle_time);
+
+    pthread_mutex_unlock(&depot_mutex);
+
+    return res;
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::get_occupancy(occupancy_stats& res)const
+{
+    pthread_mutex_lock(&depot_mutex);
+    base.get_occupancy(res);
+    pthread_mutex_unlock(&depot_mutex);
+}
+
+template <typename T, int objects_per_page, int magazine_size>
+inline void magazine_pool<T, objects_per_page, magazine_size>::set_page_source(page_source * src)
+{
+    pthread_mutex_lock(&depot_mutex);
+    base.set_page_source(src);
+    pthread_mutex_unlock(&depot_mutex);
+}
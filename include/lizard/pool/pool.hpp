@@ -15,46 +15,121 @@
 #ifndef _VAR_OBJECT_ALLOCATOR___
 #define _VAR_OBJECT_ALLOCATOR___
 
+#include <map>
+#include <new>
+#include <set>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
-
-#include "stack.h"
+#include <vector>
 
 namespace pool_ns
 {
 
 /*
 
+Where the raw memory of pool pages comes from. The default is malloc().
+
+*/
+struct page_source
+{
+    virtual ~page_source(){}
+
+    virtual void * allocate(size_t sz) = 0;
+    virtual void free(void * ptr, size_t sz) = 0;
+};
+
+struct malloc_page_source : public page_source
+{
+    void * allocate(size_t sz){return malloc(sz);}
+    void free(void * ptr, size_t){::free(ptr);}
+};
+
+/*
+
 Memory allocator for fixed size structures
 
+Objects live in pages of objects_per_page. Every page keeps its own stack of
+free slots, and an address map finds the page of a freed object. New objects
+come from the partially used page with the lowest address, so the pages at
+the end drain after a spike. A page that is completely free is released by
+trim() once it stayed free for the idle period, unless it is needed for the
+capacity asked by reserve().
+
 */
 template <typename T, int objects_per_page = 65536>
 class pool
 {
+public:
+
+    enum {OCCUPANCY_BUCKETS = 4}; // partially used pages by quarters of occupancy
+
+    struct occupancy_stats
+    {
+        u_int32_t pages;
+        u_int32_t empty_pages;
+        u_int32_t full_pages;
+        u_int32_t partial_pages[OCCUPANCY_BUCKETS];
+
+        u_int32_t objects;
+        u_int32_t capacity;        // slots in all pages
+
+        uint64_t released_pages;   // since start
+
+        double fragmentation;      // free slots in used pages / all slots in used pages
+    };
+
 protected:
 
     struct page
     {
-        page * next;
+        page_source * source;
 
         T * data;
-        T * free_node;
 
-        page();
+        T ** free_slots;
+        u_int32_t free_num;
+
+        uint64_t empty_since;      // first trim() that saw the page free, 0 if not seen yet
+
+        page(page_source * src);
         ~page();
 
         bool full()const;
+        bool empty()const;
 
         T * allocate();
+        void free(T * elem);
+    };
 
-        void attach(page * p);
+    struct by_address
+    {
+        bool operator()(const page * a, const page * b)const
+        {
+            return a->data < b->data;
+        }
     };
 
-    stack<T*> free_nodes;
+    typedef std::map<T *, page *> address_map;
+    typedef std::set<page *, by_address> page_set;
+
+    address_map pages;             // by the address of the first object
 
-    page * root;
+    page_set partial;              // neither full nor empty
+    std::vector<page *> empty_pages;
 
-    u_int16_t pages_num;
     u_int32_t objects_num;
+    uint64_t released_num;
+
+    u_int32_t reserved_pages;      // trim() keeps at least so many pages
+
+    page_source * source;
+    malloc_page_source default_source;
+
+    pool(const pool&);
+    pool& operator=(const pool&);
+
+    page * page_of(T * elem)const;
 
 public:
     pool();
@@ -66,8 +141,21 @@ public:
 
     size_t    page_size()const;
 
+    // for pages allocated after the call; the source must outlive the pool
+    void set_page_source(page_source * src);
+
     T * allocate();
     void free(T * elem);
+
+    // creates and touches pages up to the capacity of 'objects' and keeps
+    // them from trim(); returns the number of new pages
+    u_int32_t reserve(u_int32_t objects);
+
+    // releases pages that stayed free for idle_time (in the units of 'now');
+    // returns the number of released pages
+    u_int32_t trim(uint64_t now, uint64_t idle_time);
+
+    void get_occupancy(occupancy_stats& res)const;
 };
 
 #include "pool.tcc"
@@ -13,33 +13,53 @@
 */
 
 template <typename T, int objects_per_page>
-inline pool<T, objects_per_page>::page::page() : next(0), data(0), free_node(data)
+inline pool<T, objects_per_page>::page::page(page_source * src) : source(src), data(0), free_slots(0), free_num(0), empty_since(0)
 {
-    data = new T[objects_per_page];
-    free_node = data;
+    data = (T *)source->allocate(objects_per_page * sizeof(T));
+    if(0 == data)
+    {
+        throw std::bad_alloc();
+    }
+
+    for(int i = 0; i < objects_per_page; i++)
+    {
+        new (data + i) T;
+    }
+
+    free_slots = new T*[objects_per_page];
+
+    // the lowest addresses go first
+    for(int i = 0; i < objects_per_page; i++)
+    {
+        free_slots[i] = data + objects_per_page - 1 - i;
+    }
+
+    free_num = objects_per_page;
 }
 
 template <typename T, int objects_per_page>
 inline pool<T, objects_per_page>::page::~page()
 {
-    delete[] data;
+    delete[] free_slots;
 
-    if(next)
+    for(int i = 0; i < objects_per_page; i++)
     {
-        delete next;
+        data[i].~T();
     }
+
+    source->free(data, objects_per_page * sizeof(T));
 }
 
 template <typename T, int objects_per_page>
 inline bool pool<T, objects_per_page>::page::full()const
 {
-    return free_node >= data + objects_per_page;
+    return 0 == free_num;
 }
 
 template <typename T, int objects_per_page>
-inline void pool<T, objects_per_page>::page::attach(pool<T, objects_per_page>::page * pg)
+inline bool pool<T, objects_per_page>::page::empty()const
 {
-    next = pg;
+    return objects_per_page == (int)free_num;
 }
 
 template <typename T, int objects_per_page>
@@ -51,35 +71,52 @@ inline T * pool<T, objects_per_page>::page::allocate()
     }
     else
     {
-        T * ret = free_node;
+        empty_since = 0;
 
-        free_node++;
-
-        return ret;
+        return free_slots[--free_num];
     }
 }
 
 template <typename T, int objects_per_page>
-inline pool<T, objects_per_page>::pool() : root(0), pages_num(0), objects_num(0)
+inline void pool<T, objects_per_page>::page::free(T * elem)
 {
-    root = new page;
+    free_slots[free_num++] = elem;
+}
 
-    pages_num = 1;
-    objects_num = 0;
+template <typename T, int objects_per_page>
+inline pool<T, objects_per_page>::pool() : objects_num(0), released_num(0), reserved_pages(0), source(&default_source)
+{
 
-    free_nodes.reserve(objects_per_page);
 }
 
 template <typename T, int objects_per_page>
 inline pool<T, objects_per_page>::~pool()
 {
-    delete root;
+    for(typename address_map::iterator it = pages.begin(); it != pages.end(); ++it)
+    {
+        delete it->second;
+    }
+}
+
+template <typename T, int objects_per_page>
+inline typename pool<T, objects_per_page>::page * pool<T, objects_per_page>::page_of(T * elem)const
+{
+    typename address_map::const_iterator it = pages.upper_bound(elem);
+
+    if(it == pages.begin())
+    {
+        return 0;
+    }
+
+    --it;
+
+    return (elem < it->first + objects_per_page) ? it->second : 0;
 }
 
 template <typename T, int objects_per_page>
 inline u_int32_t pool<T, objects_per_page>::allocated_pages()const
 {
-    return pages_num;
+    return (u_int32_t)pages.size();
 }
 
 template <typename T, int objects_per_page>
@@ -100,29 +137,44 @@ inline size_t pool<T, objects_per_page>::page_size()const
     return objects_per_page * sizeof(T);
 }
 
+template <typename T, int objects_per_page>
+inline void pool<T, objects_per_page>::set_page_source(page_source * src)
+{
+    source = src ? src : &default_source;
+}
+
 template <typename T, int objects_per_page>
 inline T * pool<T, objects_per_page>::allocate()
 {
-    T * ret_ptr = 0;
+    page * pg = 0;
 
-    if(!free_nodes.empty())
+    if(!partial.empty())
     {
-        ret_ptr = free_nodes.pop();
+        pg = *partial.begin();
+    }
+    else if(!empty_pages.empty())
+    {
+        // the most recently freed one, the others keep ageing towards release
+        pg = empty_pages.back();
+        empty_pages.pop_back();
     }
     else
     {
-        ret_ptr = root->allocate();
+        pg = new page(source);
+        pages[pg->data] = pg;
+    }
 
-        if(0 == ret_ptr)
-        {
-            page * n = root;
-            root = new page;
-            root->attach(n);
+    bool was_empty = pg->empty();
 
-            pages_num++;
+    T * ret_ptr = pg->allocate();
 
-            ret_ptr = root->allocate();
-        }
+    if(pg->full())
+    {
+        partial.erase(pg);
+    }
+    else if(was_empty)
+    {
+        partial.insert(pg);
     }
 
     objects_num++;
@@ -133,6 +185,136 @@ inline T * pool<T, objects_per_page>::allocate()
 template <typename T, int objects_per_page>
 inline void pool<T, objects_per_page>::free(T * elem)
 {
-    free_nodes.push(elem);
+    page * pg = page_of(elem);
+
+    if(0 == pg)
+    {
+        return; // not ours
+    }
+
+    bool was_full = pg->full();
+
+    pg->free(elem);
+
+    if(pg->empty())
+    {
+        partial.erase(pg);
+        empty_pages.push_back(pg);
+    }
+    else if(was_full)
+    {
+        partial.insert(pg);
+    }
+
     objects_num--;
 }
+
+template <typename T, int objects_per_page>
+inline u_int32_t pool<T, objects_per_page>::reserve(u_int32_t objects)
+{
+    u_int32_t created = 0;
+
+    reserved_pages = (objects + objects_per_page - 1) / objects_per_page;
+
+    while(pages.size() < reserved_pages)
+    {
+        page * pg = new page(source);
+        pages[pg->data] = pg;
+
+        empty_pages.push_back(pg);
+
+        // the constructors leave parts of the objects untouched
+        volatile uint8_t * mem = (volatile uint8_t *)pg->data;
+
+        for(size_t off = 0; off < objects_per_page * sizeof(T); off += 4096)
+        {
+            mem[off] = mem[off];
+        }
+
+        created++;
+    }
+
+    return created;
+}
+
+template <typename T, int objects_per_page>
+inline u_int32_t pool<T, objects_per_page>::trim(uint64_t now, uint64_t idle_time)
+{
+    u_int32_t released = 0;
+
+    for(size_t i = 0; i < empty_pages.size(); )
+    {
+        page * pg = empty_pages[i];
+
+        if(pages.size() <= reserved_pages)
+        {
+            break;
+        }
+
+        if(0 == pg->empty_since)
+        {
+            pg->empty_since = now ? now : 1;
+        }
+        else if(now - pg->empty_since >= idle_time)
+        {
+            empty_pages[i] = empty_pages.back();
+            empty_pages.pop_back();
+
+            pages.erase(pg->data);
+            delete pg;
+
+            released++;
+            continue;
+        }
+
+        i++;
+    }
+
+    released_num += released;
+
+    return released;
+}
+
+template <typename T, int objects_per_page>
+inline void pool<T, objects_per_page>::get_occupancy(occupancy_stats& res)const
+{
+    res.pages = (u_int32_t)pages.size();
+    res.empty_pages = (u_int32_t)empty_pages.size();
+    res.full_pages = 0;
+
+    for(int i = 0; i < OCCUPANCY_BUCKETS; i++)
+    {
+        res.partial_pages[i] = 0;
+    }
+
+    res.objects = objects_num;
+    res.capacity = res.pages * objects_per_page;
+    res.released_pages = released_num;
+
+    uint64_t used_slots = 0;
+    uint64_t holes = 0;
+
+    for(typename address_map::const_iterator it = pages.begin(); it != pages.end(); ++it)
+    {
+        const page * pg = it->second;
+
+        if(pg->full())
+        {
+            res.full_pages++;
+        }
+        else if(!pg->empty())
+        {
+            u_int32_t used = objects_per_page - pg->free_num;
+            res.partial_pages[(uint64_t)used * OCCUPANCY_BUCKETS / objects_per_page]++;
+
+            holes += pg->free_num;
+        }
+
+        if(!pg->empty())
+        {
+            used_slots += objects_per_page;
+        }
+    }
+
+    res.fragmentation = used_slots ? (double)holes / used_slots : 0.0;
+}
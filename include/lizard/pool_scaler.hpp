@@ -0,0 +1,111 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_POOL_SCALER_HPP__
+#define __LIZARD_POOL_SCALER_HPP__
+
+#include <deque>
+#include <pthread.h>
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Sizing policy for a worker pool between min and max threads.
+
+Scale up: the queue is under pressure (a task waited longer than the limit, or
+no thread is idle and the queue is at least as long as the pool) for
+UP_TICKS ticks in a row; the pool grows by half its size.
+
+Scale down: some threads stayed idle with no pressure for 'idle_time'; half
+of the threads that were idle all that time retire.
+
+Both directions respect a cooldown after the previous change. The fast way up
+and the slow way down are the hysteresis that keeps the pool from flapping.
+
+*/
+class pool_scaler
+{
+public:
+    enum {TICK_US = 100000}; // expected period of tick() calls
+    enum {UP_TICKS = 2};
+    enum {COOLDOWN_US = 500000};
+    enum {EVENTS_NUM = 16};
+
+    struct event
+    {
+        time_t time;
+        int from;
+        int to;
+        std::string reason;
+    };
+
+private:
+
+    int min_threads;
+    int max_threads;
+
+    uint64_t wait_limit; // us
+    uint64_t idle_time;  // us
+
+    uint64_t last_change;
+
+    int pressure_ticks;
+
+    uint64_t idle_since;
+    int idle_min;
+
+    uint64_t ups;
+    uint64_t downs;
+
+    mutable pthread_mutex_t mutex; // events are read by the stats thread
+    std::deque<event> events;
+
+    pool_scaler(const pool_scaler&);
+    pool_scaler& operator=(const pool_scaler&);
+
+    void add_event(int from, int to, const char * reason);
+
+public:
+
+    pool_scaler();
+    ~pool_scaler();
+
+    void init(int min_th, int max_th, uint64_t wait_limit_us, uint64_t idle_time_us);
+
+    bool enabled()const;
+
+    int get_min()const;
+    int get_max()const;
+
+    // called every TICK_US by one thread; returns the number of threads
+    // to start (> 0) or to retire (< 0)
+    int tick(uint64_t now, int threads, int idle_threads, size_t queue_len, uint64_t max_wait);
+
+    uint64_t get_ups()const;
+    uint64_t get_downs()const;
+
+    void get_events(std::vector<event>& res)const;
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
@@ -16,11 +16,20 @@
 #define __LIZARD_SERVER_HPP__
 
 #include <cstdarg>
-#include <deque>
+#include <map>
+#include <set>
+#include <lizard/acl.hpp>
+#include <lizard/affinity.hpp>
 #include <lizard/config.hpp>
 #include <lizard/fd_map.hpp>
+#include <lizard/mem_region.hpp>
+#include <lizard/mpsc_list.hpp>
 #include <lizard/plugin_factory.hpp>
+#include <lizard/pool_scaler.hpp>
 #include <lizard/statistics.hpp>
+#include <lizard/stealing_queue.hpp>
+#include <lizard/task_queue.hpp>
+#include <lizard/timer_service.hpp>
 #include <lizard/utils.hpp>
 #include <stdexcept>
 #include <sys/epoll.h>
@@ -41,8 +50,44 @@ class server
         void init(server * srv);
         void log_message(plugin_log_levels log_level, const char * param_str, ...);
         void vlog_message(plugin_log_levels log_lebel, const char * param_str, va_list ap);
+
+        bool complete_task(lizard::task * tsk, int result);
+        bool watch_fd(int fd, uint32_t events, void (*cb)(void * arg, uint32_t events), void * arg);
+
+        uint64_t schedule_after(uint32_t ms, void (*cb)(void * arg), void * arg);
+        uint64_t schedule_every(uint32_t ms, void (*cb)(void * arg), void * arg);
+        bool cancel_timer(uint64_t id);
+    };
+
+    // one-shot fd watch requested by plugin, lives in epoll_event.data.u64 tagged with WATCH_TAG
+    struct fd_watch
+    {
+        int fd;
+        void (*cb)(void * arg, uint32_t events);
+        void * arg;
     };
 
+    static const uint64_t WATCH_TAG = 1ULL << 63;
+
+    // budget of a task passed to a hard thread, see <hard_timeout>
+    struct hard_deadline
+    {
+        uint64_t when;
+        uint64_t seq;   // stale if it is not in hard_pending
+        http * task;
+        std::string route; // uri path, taken while the task is not shared yet
+    };
+
+    struct later_deadline
+    {
+        bool operator()(const hard_deadline& a, const hard_deadline& b)const
+        {
+            return a.when > b.when;
+        }
+    };
+
+    enum {HARD_TIMEOUT_ROUTES = 256}; // routes counted separately, the rest go to "other"
+
     enum {LISTEN_QUEUE_SZ = 1024};
     enum {HINT_EPOLL_SIZE = 10000};
     enum {EPOLL_EVENTS = 2000};
@@ -55,24 +100,24 @@ class server
     pthread_t stats_th;
     pthread_t idle_th;
 
-    mutable pthread_mutex_t     easy_proc_mutex;
-    mutable pthread_cond_t      easy_proc_cond;
-
-    mutable pthread_mutex_t     hard_proc_mutex;
-    mutable pthread_cond_t      hard_proc_cond;
-
     mutable pthread_mutex_t     stats_proc_mutex;
     mutable pthread_cond_t      stats_proc_cond;
 
+    mutable pthread_mutex_t     acl_mutex;
 
-    mutable pthread_mutex_t     done_mutex;
+    mutable pthread_mutex_t     hard_pool_mutex; // hard_th, hard_retired and threads_num once workers run
 
-    std::deque<http*>           easy_queue;
-    std::deque<http*>           hard_queue;
-    std::deque<http*>           done_queue;
+    task_queue<http*>           easy_queue;
+    stealing_queue<http*>       easy_stealing_queue; // replaces easy_queue in work stealing mode
+    task_queue<http*>           hard_queue;
+    mpsc_list<http>             done_list;
 
+    mem_region                  conn_region; // pages of fds' pool, must outlive fds
     fd_map                      fds;
 
+    acl *                       acl_active;  // used by epoll thread only
+    acl *                       acl_pending; // loaded by idle thread, picked up by epoll thread
+
     plugin_factory              factory;
 
     const char *                config_path; // for passing to plugins
@@ -84,11 +129,38 @@ class server
     int stats_sock;
     int epoll_sock;
 
-    int epoll_wakeup_isock;
-    int epoll_wakeup_osock;
+    int epoll_wakeup_fd;      // eventfd
+    int epoll_sleeping;       // epoll thread is (about to be) in epoll_wait
 
     int threads_num;
 
+    size_t easy_th_ids;
+    size_t hard_th_ids;
+
+    thread_placement            placement;
+
+    timer_service               timers;
+
+    pool_scaler                 hard_scaler;
+    std::vector<pthread_t>      hard_retired;     // exited hard threads not joined yet
+    int                         hard_th_num;      // running hard threads
+    int                         hard_th_idle;     // hard threads waiting for a task
+    int                         hard_th_retiring; // hard threads asked to exit
+    uint64_t                    hard_max_wait;    // max hard queue wait since last scaling check, us
+    uint64_t                    hard_scale_time;  // last scaling check, used by epoll thread only
+
+    mutable pthread_mutex_t     hard_timeout_mutex; // hard_deadlines_new/dropped and timeout counters
+    uint64_t                    hard_seq_ids;
+    std::vector<hard_deadline>  hard_deadlines_new; // registered by push_hard
+    std::vector<uint64_t>       hard_deadlines_dropped; // push_hard failed after registering
+    std::vector<hard_deadline>  hard_deadlines;     // heap, epoll thread only
+    std::map<uint64_t, http *>  hard_pending;       // tasks still on hard threads by seq, epoll thread only
+    uint64_t                    hard_timeouts_total;
+    std::map<std::string, uint64_t> hard_timeouts;  // by uri path
+
+    bool                        accept_paused;  // incoming_sock is out of epoll, epoll thread only
+    std::set<int>               paused_bodies;  // connections waiting for memory to read a body
+
     time_t                      start_time;
     // network part
 
@@ -98,8 +170,27 @@ class server
 
     void timeouts_kill_oldest();
 
+    void init_queues();
+    void init_placement();
+
+    void warm_up();
+
+    void start_hard_thread();
+    void scale_hard_pool();
+    bool hard_thread_retires();
+
+    void merge_hard_deadlines();
+    void forget_hard_deadline(uint64_t seq);
+    void check_hard_timeouts();
+    void abandon_hard_task(http *, const std::string& route);
+
+    void check_memory_budget();
+
+    void load_acl();
+    void apply_acl();
+
     void epoll_processing_loop();
-    void easy_processing_loop();
+    void easy_processing_loop(size_t id);
     void hard_processing_loop();
     void idle_processing_loop();
 
@@ -110,17 +201,26 @@ class server
     bool process_event(const epoll_event&);
     bool process(http *);
 
+    // runs plugin's handle_easy; true if the response is ready, false if the task went to hard queue
+    // or stays with the plugin
+    bool run_easy(http *);
+    bool dispatch_easy_result(http *, int result);
+
+    bool complete_task(http *, int result);
+    bool watch_fd(int fd, uint32_t events, void (*cb)(void * arg, uint32_t events), void * arg);
+    void process_watch(const epoll_event&);
+
     void epoll_send_wakeup();
     void epoll_recv_wakeup();
 
     bool push_easy(http *);
-    bool pop_easy_or_wait(http**);
+    bool pop_easy_or_wait(size_t id, http**);
 
     bool push_hard(http *);
     bool pop_hard_or_wait(http**);
 
     bool push_done(http *);
-    bool pop_done(http**);
+    http * pop_done_all();
 
     void fire_all_threads();
 
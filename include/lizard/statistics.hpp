@@ -15,6 +15,9 @@
 #ifndef __LIZARD_STATS_HPP___
 #define __LIZARD_STATS_HPP___
 
+#include <lizard/mpmc_queue.hpp>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -22,29 +25,73 @@ namespace lizard {
 
 //---------------------------------------------------------------------------------------------
 
+/*
+
+Hot counters live in per-thread shards, one cache line each, so the request
+path never writes a line another core writes. A thread takes a shard on its
+first report and gives it back when it exits. Totals are cumulative and
+exact; min/max values belong to the current window and are collected by
+process() every TIME_DELTA seconds.
+
+*/
 struct statistics
 {
     enum {TIME_DELTA = 4};
+    enum {MAX_SHARDS = 128};
+
+    struct shard
+    {
+        uint64_t requests_count;  // cumulative
+        uint64_t resp_time_total; // cumulative
+
+        uint64_t window;          // window of the fields below
+        uint64_t resp_time_min;
+        uint64_t resp_time_max;
+        size_t eq_ml, hq_ml, dq_ml;
+    }
+    __attribute__((aligned(CACHE_LINE_SZ)));
+
+private:
+
+    shard shards[MAX_SHARDS];
+    bool  shard_used[MAX_SHARDS];
+    int   shards_num;
+
+    mutable pthread_mutex_t registry_mutex; // shards registry and window switching
+    pthread_key_t shard_key;
+
+    uint64_t retired_requests_count;  // totals of shards given back
+    uint64_t retired_resp_time_total;
+
+    uint64_t window;
 
     time_t last_processed_time;
+    uint64_t last_requests_count;
+    uint64_t last_resp_time_total;
+
+    volatile double resp_time_min, resp_time_mid, resp_time_max, avg_rps;
+
+    statistics(const statistics&);
+    statistics& operator=(const statistics&);
+
+    shard * get_shard();
+    shard * get_window_shard();
+    void release_shard(shard *);
+
+    static void release_shard_key(void *);
 
-    volatile int requests_count;
-    volatile uint64_t resp_time_total;
-    volatile double resp_time_min, resp_time_mid, resp_time_max, min_t, max_t, avg_rps;
-    volatile size_t eq_ml, hq_ml, dq_ml;
 public:
 
-    volatile size_t easy_queue_len;
     volatile size_t easy_queue_max_len;
-    volatile size_t hard_queue_len;
     volatile size_t hard_queue_max_len;
-    volatile size_t done_queue_len;
+    volatile size_t done_queue_len;      // epoll thread only
     volatile size_t done_queue_max_len;
 
     volatile size_t objects_in_http_pool;
     volatile size_t pages_in_http_pool;
 
     statistics();
+    ~statistics();
 
     void process();
     void report_response_time(uint64_t time);
@@ -58,10 +105,12 @@ public:
     double get_max_lifetime()const;
 
     double get_rps()const;
+
+    uint64_t get_requests_count()const;
+    int get_shards_num()const;
 };
 
 //---------------------------------------------------------------------------------------------
 }
 
 #endif
-
@@ -0,0 +1,117 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_STEALING_QUEUE_HPP__
+#define __LIZARD_STEALING_QUEUE_HPP__
+
+#include <lizard/mpmc_queue.hpp>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Per-worker queues with work stealing.
+
+The producer (epoll thread) spreads tasks round-robin over the workers' own
+queues, a worker takes tasks from its own queue first and steals from the
+others when it runs dry. A task is handed to the sleeping owner first, to
+another sleeping worker when the owner is busy. Unlike Chase-Lev deques the owner is not the
+producer here, so every queue is a lock-free ring where the owner and the
+thieves take from the same end with a CAS (FIFO order is kept).
+
+The limit is global: a push fails when all queues together hold 'limit' tasks.
+
+*/
+template <typename T>
+class stealing_queue
+{
+public:
+    enum {DEFAULT_CAPACITY = 65536};
+    enum {SPIN_COUNT = 200};
+
+    struct worker_stats
+    {
+        size_t queue_len;
+        uint64_t pops;
+        uint64_t steals;
+    };
+
+private:
+
+    struct worker
+    {
+        mpmc_queue<T> * ring;
+
+        uint64_t pops;   // written by owner only
+        uint64_t steals; // written by owner only
+
+        pthread_cond_t cond;
+        bool sleeping;   // guarded by mutex
+
+        char pad[CACHE_LINE_SZ];
+
+        worker() : ring(0), pops(0), steals(0), sleeping(false){}
+    };
+
+    std::vector<worker> workers;
+
+    size_t limit;
+    size_t next_worker; // producer only
+
+    size_t queued;
+
+    mutable pthread_mutex_t mutex;
+
+    int sleepers;
+    int spin_count;
+
+    stealing_queue(const stealing_queue&);
+    stealing_queue& operator=(const stealing_queue&);
+
+    void clear();
+    void wake(size_t id);
+    bool take(size_t id, T * el, bool steal);
+
+public:
+
+    stealing_queue();
+    ~stealing_queue();
+
+    void init(size_t workers_num, size_t lim);
+
+    size_t workers_num()const;
+
+    bool push(const T& el, size_t * q_len = 0);
+
+    // returns false when woken up without a task
+    bool pop_or_wait(size_t id, T * el, size_t * q_len = 0);
+
+    size_t size()const;
+
+    void get_worker_stats(size_t id, worker_stats& ws)const;
+
+    void fire_all();
+};
+
+//-----------------------------------------------------------------
+}
+
+#include "stealing_queue.tcc"
+
+#endif
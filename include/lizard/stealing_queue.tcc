@@ -0,0 +1,238 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+namespace lizard
+{
+//-------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline stealing_queue<T>::stealing_queue() : limit(0), next_worker(0), queued(0), sleepers(0), spin_count(0)
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+template <typename T>
+inline stealing_queue<T>::~stealing_queue()
+{
+    clear();
+
+    pthread_mutex_destroy(&mutex);
+}
+
+template <typename T>
+inline void stealing_queue<T>::clear()
+{
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        delete workers[i].ring;
+        pthread_cond_destroy(&workers[i].cond);
+    }
+
+    workers.clear();
+}
+
+template <typename T>
+inline void stealing_queue<T>::init(size_t workers_num, size_t lim)
+{
+    clear();
+
+    limit = lim;
+    next_worker = 0;
+    queued = 0;
+
+    workers.resize(workers_num);
+
+    for (size_t i = 0; i < workers_num; i++)
+    {
+        workers[i].ring = new mpmc_queue<T>(limit ? limit : (size_t)DEFAULT_CAPACITY);
+        pthread_cond_init(&workers[i].cond, 0);
+    }
+
+    spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_COUNT : 0;
+}
+
+template <typename T>
+inline size_t stealing_queue<T>::workers_num()const
+{
+    return workers.size();
+}
+
+template <typename T>
+inline bool stealing_queue<T>::push(const T& el, size_t * q_len)
+{
+    size_t sz = __atomic_load_n(&queued, __ATOMIC_RELAXED);
+
+    if (q_len)
+    {
+        *q_len = sz;
+    }
+
+    if (workers.empty() || (limit && sz >= limit))
+    {
+        return false;
+    }
+
+    bool res = false;
+    size_t id = 0;
+
+    for (size_t i = 0; i < workers.size() && !res; i++)
+    {
+        id = next_worker++ % workers.size();
+
+        res = workers[id].ring->push(el);
+    }
+
+    if (res)
+    {
+        __atomic_add_fetch(&queued, 1, __ATOMIC_RELAXED);
+
+        // pairs with the sleepers increment in pop_or_wait()
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&sleepers, __ATOMIC_RELAXED))
+        {
+            wake(id);
+        }
+    }
+
+    return res;
+}
+
+template <typename T>
+inline void stealing_queue<T>::wake(size_t id)
+{
+    pthread_mutex_lock(&mutex);
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        worker& w = workers[(id + i) % workers.size()];
+
+        if (w.sleeping)
+        {
+            w.sleeping = false;
+            pthread_cond_signal(&w.cond);
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+template <typename T>
+inline bool stealing_queue<T>::take(size_t id, T * el, bool steal)
+{
+    worker& w = workers[id];
+
+    if (w.ring->pop(*el))
+    {
+        w.pops++;
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+
+        return true;
+    }
+
+    if (!steal)
+    {
+        return false;
+    }
+
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        if (workers[(id + i) % workers.size()].ring->pop(*el))
+        {
+            w.pops++;
+            w.steals++;
+            __atomic_sub_fetch(&queued, 1, __ATOMIC_RELAXED);
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <typename T>
+inline bool stealing_queue<T>::pop_or_wait(size_t id, T * el, size_t * q_len)
+{
+    if (q_len)
+    {
+        *q_len = __atomic_load_n(&queued, __ATOMIC_RELAXED);
+    }
+
+    // the first half of spinning waits for own tasks only, so that a busy
+    // owner is not robbed of every task it has been given
+    for (int i = 0; i <= spin_count; i++)
+    {
+        if (take(id, el, i >= spin_count / 2))
+        {
+            return true;
+        }
+
+        cpu_relax();
+    }
+
+    worker& w = workers[id];
+
+    pthread_mutex_lock(&mutex);
+
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+
+    bool ret = take(id, el, true);
+
+    if (!ret)
+    {
+        w.sleeping = true;
+        pthread_cond_wait(&w.cond, &mutex);
+        w.sleeping = false;
+    }
+
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&mutex);
+
+    return ret || take(id, el, true);
+}
+
+template <typename T>
+inline size_t stealing_queue<T>::size()const
+{
+    return __atomic_load_n(&queued, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+inline void stealing_queue<T>::get_worker_stats(size_t id, worker_stats& ws)const
+{
+    const worker& w = workers[id];
+
+    ws.queue_len = w.ring->size();
+    ws.pops = w.pops;
+    ws.steals = w.steals;
+}
+
+template <typename T>
+inline void stealing_queue<T>::fire_all()
+{
+    pthread_mutex_lock(&mutex);
+
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        pthread_cond_broadcast(&workers[i].cond);
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+//-------------------------------------------------------------------------------------------------------------------
+}
@@ -0,0 +1,98 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_TASK_QUEUE_HPP__
+#define __LIZARD_TASK_QUEUE_HPP__
+
+#include <deque>
+#include <lizard/mpmc_queue.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Blocking queue between server threads.
+
+qLocked   - std::deque under mutex, every push signals the condition.
+qLockFree - bounded mpmc_queue; consumers spin shortly before going to sleep
+            (on SMP only) and producers touch the mutex only when somebody
+            is sleeping.
+
+*/
+template <typename T>
+class task_queue
+{
+public:
+    enum queue_type {qLocked, qLockFree};
+
+    enum {DEFAULT_CAPACITY = 65536};
+    enum {SPIN_COUNT = 200};
+
+private:
+
+    queue_type type;
+    size_t limit;
+
+    mutable pthread_mutex_t mutex;
+    mutable pthread_cond_t  cond;
+
+    std::deque<T> queue;
+
+    mpmc_queue<T> * ring;
+
+    int sleepers;
+    int spin_count;
+
+    task_queue(const task_queue&);
+    task_queue& operator=(const task_queue&);
+
+    void wake_one();
+
+public:
+
+    task_queue();
+    ~task_queue();
+
+    // limit == 0 means no limit (bounded by DEFAULT_CAPACITY for qLockFree)
+    void init(queue_type tp, size_t lim);
+
+    queue_type get_type()const;
+
+    // q_len receives queue length seen before the push/pop
+    bool push(const T& el, size_t * q_len = 0);
+
+    // pushes ignoring the limit, yields while a lock-free queue is full
+    void push_force(const T& el, size_t * q_len = 0);
+
+    bool try_pop(T * el, size_t * q_len = 0);
+
+    // returns false when woken up without a task
+    bool pop_or_wait(T * el, size_t * q_len = 0);
+
+    size_t size()const;
+
+    void fire_all();
+};
+
+//-----------------------------------------------------------------
+}
+
+#include "task_queue.tcc"
+
+#endif
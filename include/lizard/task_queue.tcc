@@ -0,0 +1,284 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+namespace lizard
+{
+//-------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+inline task_queue<T>::task_queue() : type(qLocked), limit(0), ring(0), sleepers(0), spin_count(0)
+{
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&cond, 0);
+}
+
+template <typename T>
+inline task_queue<T>::~task_queue()
+{
+    delete ring;
+
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+template <typename T>
+inline void task_queue<T>::init(queue_type tp, size_t lim)
+{
+    type = tp;
+    limit = lim;
+
+    queue.clear();
+
+    delete ring;
+    ring = 0;
+
+    if (qLockFree == type)
+    {
+        ring = new mpmc_queue<T>(limit ? limit : (size_t)DEFAULT_CAPACITY);
+    }
+
+    spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_COUNT : 0;
+}
+
+template <typename T>
+inline typename task_queue<T>::queue_type task_queue<T>::get_type()const
+{
+    return type;
+}
+
+template <typename T>
+inline void task_queue<T>::wake_one()
+{
+    // pairs with the sleepers increment in pop_or_wait(): either the consumer
+    // sees our element on its last check, or we see it sleeping
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&sleepers, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&mutex);
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+}
+
+template <typename T>
+inline bool task_queue<T>::push(const T& el, size_t * q_len)
+{
+    bool res = false;
+
+    if (qLocked == type)
+    {
+        pthread_mutex_lock(&mutex);
+
+        size_t sz = queue.size();
+
+        if (q_len)
+        {
+            *q_len = sz;
+        }
+
+        if (0 == limit || sz < limit)
+        {
+            queue.push_back(el);
+            res = true;
+
+            pthread_cond_signal(&cond);
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+    else
+    {
+        size_t sz = ring->size();
+
+        if (q_len)
+        {
+            *q_len = sz;
+        }
+
+        if ((0 == limit || sz < limit) && ring->push(el))
+        {
+            res = true;
+
+            wake_one();
+        }
+    }
+
+    return res;
+}
+
+template <typename T>
+inline void task_queue<T>::push_force(const T& el, size_t * q_len)
+{
+    if (qLocked == type)
+    {
+        pthread_mutex_lock(&mutex);
+
+        if (q_len)
+        {
+            *q_len = queue.size();
+        }
+
+        queue.push_back(el);
+
+        pthread_cond_signal(&cond);
+
+        pthread_mutex_unlock(&mutex);
+    }
+    else
+    {
+        if (q_len)
+        {
+            *q_len = ring->size();
+        }
+
+        while (!ring->push(el))
+        {
+            sched_yield();
+        }
+
+        wake_one();
+    }
+}
+
+template <typename T>
+inline bool task_queue<T>::try_pop(T * el, size_t * q_len)
+{
+    bool ret = false;
+
+    if (qLocked == type)
+    {
+        pthread_mutex_lock(&mutex);
+
+        size_t sz = queue.size();
+
+        if (q_len)
+        {
+            *q_len = sz;
+        }
+
+        if (sz)
+        {
+            *el = queue.front();
+            queue.pop_front();
+
+            ret = true;
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+    else
+    {
+        if (q_len)
+        {
+            *q_len = ring->size();
+        }
+
+        ret = ring->pop(*el);
+    }
+
+    return ret;
+}
+
+template <typename T>
+inline bool task_queue<T>::pop_or_wait(T * el, size_t * q_len)
+{
+    bool ret = false;
+
+    if (qLocked == type)
+    {
+        pthread_mutex_lock(&mutex);
+
+        size_t sz = queue.size();
+
+        if (q_len)
+        {
+            *q_len = sz;
+        }
+
+        if (sz)
+        {
+            *el = queue.front();
+            queue.pop_front();
+
+            ret = true;
+        }
+        else
+        {
+            pthread_cond_wait(&cond, &mutex);
+        }
+
+        pthread_mutex_unlock(&mutex);
+
+        return ret;
+    }
+
+    if (q_len)
+    {
+        *q_len = ring->size();
+    }
+
+    for (int i = 0; i < spin_count; i++)
+    {
+        if (ring->pop(*el))
+        {
+            return true;
+        }
+
+        cpu_relax();
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    __atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+
+    ret = ring->pop(*el);
+
+    if (!ret)
+    {
+        pthread_cond_wait(&cond, &mutex);
+    }
+
+    __atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&mutex);
+
+    return ret || ring->pop(*el);
+}
+
+template <typename T>
+inline size_t task_queue<T>::size()const
+{
+    if (qLocked == type)
+    {
+        pthread_mutex_lock(&mutex);
+        size_t sz = queue.size();
+        pthread_mutex_unlock(&mutex);
+
+        return sz;
+    }
+
+    return ring->size();
+}
+
+template <typename T>
+inline void task_queue<T>::fire_all()
+{
+    pthread_mutex_lock(&mutex);
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+}
+
+//-------------------------------------------------------------------------------------------------------------------
+}
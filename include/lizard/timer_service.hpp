@@ -0,0 +1,123 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_TIMER_SERVICE_HPP__
+#define __LIZARD_TIMER_SERVICE_HPP__
+
+#include <lizard/affinity.hpp>
+#include <pthread.h>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+One-shot and periodic callbacks for plugins.
+
+Timers sit in a min-heap by due time; a few executor threads wait for the
+earliest one on a condition variable and run callbacks outside the lock. A
+periodic timer is out of the heap while its callback runs, so it never runs
+twice at once, and its next run is counted from the planned time (from now if
+it is late by more than a period).
+
+stop() joins the executors and drops every timer: callbacks belong to the
+plugin and must not outlive it.
+
+*/
+class timer_service
+{
+public:
+    typedef void (*callback)(void * arg);
+
+    struct stats
+    {
+        size_t scheduled;
+        uint64_t runs;
+        uint64_t max_lag; // us, worst delay of a run behind its due time
+    };
+
+private:
+
+    struct timer
+    {
+        uint64_t id;
+        uint64_t when;   // us, CLOCK_MONOTONIC
+        uint64_t period; // us, 0 for one-shot
+
+        callback cb;
+        void * arg;
+    };
+
+    struct later
+    {
+        bool operator()(const timer& a, const timer& b)const
+        {
+            return a.when > b.when;
+        }
+    };
+
+    mutable pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    std::vector<timer> heap;
+    std::set<uint64_t> active; // ids not fired (one-shot) or not cancelled
+
+    uint64_t next_id;
+
+    std::vector<pthread_t> threads;
+    bool stopping;
+
+    const thread_placement * placement;
+
+    uint64_t runs;
+    uint64_t max_lag;
+
+    timer_service(const timer_service&);
+    timer_service& operator=(const timer_service&);
+
+    uint64_t schedule(uint64_t delay, uint64_t period, callback cb, void * arg);
+
+    void processing_loop();
+
+    static uint64_t now();
+
+    friend void * timer_loop_function(void * ptr);
+
+public:
+
+    timer_service();
+    ~timer_service();
+
+    // throws std::logic_error if a thread can't be created
+    void start(int threads_num, const thread_placement * pl);
+    void stop();
+
+    // return the timer id or 0 if the arguments are wrong
+    uint64_t schedule_after(uint32_t ms, callback cb, void * arg);
+    uint64_t schedule_every(uint32_t ms, callback cb, void * arg);
+
+    // false if the timer has fired (one-shot) or is unknown; a callback already running is not waited for
+    bool cancel(uint64_t id);
+
+    void get_stats(stats& res)const;
+};
+
+//-----------------------------------------------------------------
+}
+
+#endif
@@ -0,0 +1,47 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_URL_PARAMS_HPP__
+#define __LIZARD_URL_PARAMS_HPP__
+
+#include <lizard/arena.hpp>
+#include <lizard/plugin.hpp>
+#include <stddef.h>
+
+namespace lizard
+{
+//-----------------------------------------------------------------
+
+/*
+
+Decoding of query strings and application/x-www-form-urlencoded bodies.
+
+url_decode() turns '+' into a space and "%XX" into its byte, a malformed
+escape stays as it is. Runs without them are copied 16 bytes at a time
+with SSE2 where there is one, so dst must hold len bytes even if the
+result is shorter.
+
+parse_params() splits pairs on '&' and the first '=', skips empty ones and
+decodes keys and values to NUL-terminated strings in the arena.
+
+*/
+size_t url_decode(const char * src, size_t len, char * dst);
+
+// false if the arena has no memory
+bool parse_params(const char * data, size_t len, arena& mem, request_params& res);
+
+//-----------------------------------------------------------------
+}
+
+#endif
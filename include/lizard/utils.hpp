@@ -18,6 +18,7 @@
 #include <stdint.h>
 
 struct in_addr;
+struct sockaddr_storage;
 
 namespace lz_utils {
 
@@ -29,7 +30,7 @@ void set_socket_timeout(int fd, long timeout);
 int set_nonblocking(int fd);
 int add_listener(const char * host_desc, const char * port_desc, int listen_q_sz = 1024);
 int add_sender(const char * host_desc, const char * port_desc);
-int accept_new_connection(int fd, struct in_addr& ip);
+int accept_new_connection(int fd, struct in_addr& ip, struct sockaddr_storage * peer = 0);
 
 }
 
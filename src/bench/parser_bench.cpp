@@ -0,0 +1,222 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+
+Request head parsing: the former line by line strchr() parser against every
+http_scan variant the cpu runs, on a few typical heads. Every iteration
+copies the head to a working buffer first, as the server reads it into a
+page; the scanners must agree on the result.
+
+    lz_parser_bench [iterations]
+
+*/
+
+#include <lizard/http_scan.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+
+static const char * heads[][2] =
+{
+    {"short", "GET /ping HTTP/1.0\r\n\r\n"},
+
+    {"api", "GET /v1/banner?place=1234&size=240x400&ref=http%3A%2F%2Fexample.com%2F HTTP/1.1\r\n"
+        "Host: ads.example.com\r\n"
+        "Accept: */*\r\n"
+        "Connection: keep-alive\r\n"
+        "X-Forwarded-For: 10.1.2.3\r\n"
+        "\r\n"},
+
+    {"browser", "GET /static/js/app.min.js?v=20111012 HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/535.1 (KHTML, like Gecko) Chrome/14.0.835.202 Safari/535.1\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+        "Accept-Encoding: gzip,deflate,sdch\r\n"
+        "Accept-Charset: windows-1251,utf-8;q=0.7,*;q=0.3\r\n"
+        "Referer: http://www.example.com/news/2011/10/12/some-long-article-name.html\r\n"
+        "Cookie: uid=5a1c0e7f3b2d4e6f; session=b7e1c9d2a4f6e8b0c1d3e5f7a9b2c4d6; prefs=lang%3Dru%26tz%3D4; _ga=GA1.2.123456789.1318400000\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n"},
+
+    {"post", "POST /v1/events HTTP/1.1\r\n"
+        "Host: ads.example.com\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 1024\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n"},
+};
+
+enum {HEADS_NUM = sizeof(heads) / sizeof(heads[0])};
+enum {BUF_SZ = 8192};
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// the parser replaced by http_scan: NUL-terminate, strchr() for every line
+// and again for every delimiter
+static size_t legacy_parse(char * buf)
+{
+    size_t headers = 0;
+
+    char * line = buf;
+    bool title = true;
+
+    while (true)
+    {
+        char * nl = strchr(line, '\n');
+        if (!nl)
+        {
+            return 0;
+        }
+
+        char * next = nl + 1;
+
+        *nl = 0;
+        if (nl > line && nl[-1] == '\r')
+        {
+            nl[-1] = 0;
+        }
+
+        if (0 == *line)
+        {
+            return headers;
+        }
+
+        if (title)
+        {
+            char * url = strchr(line, ' ');
+            if (!url)
+            {
+                return 0;
+            }
+
+            while (*url == ' ')*url++ = 0;
+
+            char * version = strchr(url, ' ');
+            if (!version || strncasecmp(version + 1, "HTTP/", 5) || !strchr(version, '.'))
+            {
+                return 0;
+            }
+
+            char * delim = strchr(url, '?');
+            if (delim)
+            {
+                *delim = 0;
+            }
+
+            title = false;
+        }
+        else
+        {
+            char * val = strchr(line, ':');
+            if (!val)
+            {
+                return 0;
+            }
+
+            *val = 0;
+            headers++;
+        }
+
+        line = next;
+    }
+}
+
+static size_t scan_parse(char * buf, size_t len, lizard::http_head& head)
+{
+    if (lizard::http_scan::scan_head(buf, len, head))
+    {
+        return 0;
+    }
+
+    return head.fields.size();
+}
+
+int main(int argc, char * argv[])
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+    static char buf[BUF_SZ];
+    lizard::http_head head;
+
+    printf("iterations: %ld, dispatched: %s\n", iterations, lizard::http_scan::impl_name(lizard::http_scan::get_impl()));
+
+    // reference results
+    size_t expected[HEADS_NUM];
+    lizard::http_scan::set_impl(lizard::http_scan::implScalar);
+
+    for (int h = 0; h < HEADS_NUM; h++)
+    {
+        size_t len = strlen(heads[h][1]);
+        memcpy(buf, heads[h][1], len + 1);
+
+        expected[h] = scan_parse(buf, len, head);
+    }
+
+    printf("%-10s", "");
+    for (int h = 0; h < HEADS_NUM; h++)
+    {
+        printf(" %8s (%4d B)", heads[h][0], (int)strlen(heads[h][1]));
+    }
+    printf("\n");
+
+    for (int impl = -1; impl < lizard::http_scan::IMPLS_NUM; impl++)
+    {
+        if (-1 != impl && !lizard::http_scan::set_impl(impl))
+        {
+            continue;
+        }
+
+        printf("%-10s", -1 == impl ? "strchr" : lizard::http_scan::impl_name(impl));
+
+        for (int h = 0; h < HEADS_NUM; h++)
+        {
+            size_t len = strlen(heads[h][1]);
+            size_t res = 0;
+
+            double start = now();
+
+            for (long i = 0; i < iterations; i++)
+            {
+                memcpy(buf, heads[h][1], len + 1);
+
+                res = (-1 == impl) ? legacy_parse(buf) : scan_parse(buf, len, head);
+            }
+
+            double elapsed = now() - start;
+
+            if (res != expected[h])
+            {
+                printf("\n%s: %d headers instead of %d\n", heads[h][0], (int)res, (int)expected[h]);
+                return 1;
+            }
+
+            printf(" %10.1f ns/req", elapsed * 1e9 / iterations);
+        }
+
+        printf("\n");
+    }
+
+    return 0;
+}
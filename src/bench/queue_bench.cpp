@@ -0,0 +1,164 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+
+Round trip of the server pipeline: one "epoll" thread feeds the easy queue
+and drains the done queue, N "easy" threads move tasks from one to another.
+The easy queue is either shared or split per worker with work stealing.
+
+    lz_queue_bench [workers] [tasks] [in_flight]
+
+*/
+
+#include <lizard/stealing_queue.hpp>
+#include <lizard/task_queue.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+
+typedef lizard::task_queue<long> queue_t;
+typedef lizard::stealing_queue<long> stealing_queue_t;
+
+struct bench_ctx
+{
+    queue_t easy;
+    stealing_queue_t easy_stealing;
+    queue_t done;
+
+    bool stealing;
+    size_t ids;
+};
+
+enum {STOP_TASK = -1};
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void * worker(void * ptr)
+{
+    bench_ctx * ctx = (bench_ctx *)ptr;
+
+    size_t id = __atomic_fetch_add(&ctx->ids, 1, __ATOMIC_RELAXED);
+
+    while (true)
+    {
+        long task;
+
+        if (ctx->stealing ? ctx->easy_stealing.pop_or_wait(id, &task) : ctx->easy.pop_or_wait(&task))
+        {
+            if (STOP_TASK == task)
+            {
+                break;
+            }
+
+            ctx->done.push_force(task);
+        }
+    }
+
+    return 0;
+}
+
+static double run(queue_t::queue_type type, bool stealing, int workers, long tasks, long in_flight)
+{
+    bench_ctx ctx;
+    ctx.easy.init(type, 0);
+    ctx.easy_stealing.init(workers, 0);
+    ctx.done.init(type, 0);
+    ctx.stealing = stealing;
+    ctx.ids = 0;
+
+    std::vector<pthread_t> th(workers);
+
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_create(&th[i], 0, &worker, &ctx);
+    }
+
+    double start = now();
+
+    long sent = 0;
+    long received = 0;
+
+    while (received < tasks)
+    {
+        while (sent < tasks && sent - received < in_flight)
+        {
+            if (stealing)
+            {
+                ctx.easy_stealing.push(sent++);
+            }
+            else
+            {
+                ctx.easy.push(sent++);
+            }
+        }
+
+        long task;
+        while (ctx.done.try_pop(&task))
+        {
+            received++;
+        }
+    }
+
+    double elapsed = now() - start;
+
+    for (int i = 0; i < workers; i++)
+    {
+        if (stealing)
+        {
+            while (!ctx.easy_stealing.push(STOP_TASK))
+            {
+                sched_yield();
+            }
+        }
+        else
+        {
+            ctx.easy.push_force(STOP_TASK);
+        }
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_join(th[i], 0);
+    }
+
+    return elapsed;
+}
+
+int main(int argc, char * argv[])
+{
+    int workers    = argc > 1 ? atoi(argv[1]) : 4;
+    long tasks     = argc > 2 ? atol(argv[2]) : 1000000;
+    long in_flight = argc > 3 ? atol(argv[3]) : 1000;
+
+    printf("workers: %d, tasks: %ld, in flight: %ld\n", workers, tasks, in_flight);
+
+    double t_locked = run(queue_t::qLocked, false, workers, tasks, in_flight);
+    printf("%-24s %8.3f s %12.0f tasks/s\n", "std::deque + mutex:", t_locked, tasks / t_locked);
+
+    double t_lockfree = run(queue_t::qLockFree, false, workers, tasks, in_flight);
+    printf("%-24s %8.3f s %12.0f tasks/s\n", "lock-free mpmc ring:", t_lockfree, tasks / t_lockfree);
+
+    double t_stealing = run(queue_t::qLockFree, true, workers, tasks, in_flight);
+    printf("%-24s %8.3f s %12.0f tasks/s\n", "per-worker + stealing:", t_stealing, tasks / t_stealing);
+
+    return 0;
+}
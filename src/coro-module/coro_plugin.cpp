@@ -0,0 +1,104 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <lizard/coro.hpp>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+
+Coroutine plugin example: a request waits for a pipe to become readable and
+sleeps on the epoll thread, then finishes on a hard thread.
+
+*/
+
+class lz_coro : public lizard::coro_plugin
+{
+public:
+     lz_coro(lizard::server_callback *srv_cb);
+    ~lz_coro();
+
+    int set_param(const char *xml_in);
+
+    lizard::coro_handler handle(lizard::task *task);
+
+    const char* version_string() const { return "coroutine example"; }
+};
+
+extern "C" lizard::plugin *get_plugin_instance(lizard::server_callback *srv_cb)
+{
+    try
+    {
+        return new lz_coro (srv_cb);
+    }
+    catch (const std::exception &e)
+    {
+        srv_cb->log_message(lizard::log_crit, "lz_coro plugin "
+            "load failed: %s", e.what());
+    }
+
+    return NULL;
+}
+
+lz_coro:: lz_coro(lizard::server_callback *srv_cb) : coro_plugin(srv_cb)
+{
+}
+
+lz_coro::~lz_coro()
+{
+}
+
+int lz_coro::set_param(const char * /*xml_in*/)
+{
+    return rSuccess;
+}
+
+lizard::coro_handler lz_coro::handle(lizard::task *task)
+{
+    int fds[2];
+
+    if (0 != pipe2(fds, O_NONBLOCK | O_CLOEXEC))
+    {
+        co_return rError;
+    }
+
+    // stands for a backend that answers at once
+    char c = 'x';
+    ssize_t r = write(fds[1], &c, 1);
+
+    uint32_t ev = (1 == r) ? co_await wait_fd(fds[0], EPOLLIN) : 0;
+
+    bool got = (ev & EPOLLIN) && 1 == read(fds[0], &c, 1);
+
+    close(fds[0]);
+    close(fds[1]);
+
+    if (!got)
+    {
+        co_return rError;
+    }
+
+    co_await sleep(1000);
+
+    co_await offload_hard(task);
+
+    char buff[64];
+    int len = snprintf(buff, sizeof(buff), "Hello from a coroutine, %c!\n", c);
+
+    task->set_response_status  (200);
+    task->append_response_body (buff, len);
+
+    co_return rSuccess;
+}
@@ -0,0 +1,334 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <lizard/acl.hpp>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <utils/error.hpp>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+enum {ACL_LINE_SZ = 1024};
+
+//-----------------------------------------------------------------------------------------------------------
+
+static inline int key_nibble(const uint8_t * key, int i)
+{
+    return (i & 1) ? (key[i >> 1] & 0x0F) : (key[i >> 1] >> 4);
+}
+
+std::string lizard::acl::rule::to_string()const
+{
+    uint8_t masked[16];
+    memset(masked, 0, sizeof(masked));
+
+    int full_bytes = prefix_len / 8;
+    memcpy(masked, addr, full_bytes);
+
+    if (prefix_len % 8)
+    {
+        masked[full_bytes] = addr[full_bytes] & (uint8_t)(0xFF << (8 - prefix_len % 8));
+    }
+
+    char buff[INET6_ADDRSTRLEN + 16];
+    inet_ntop(family, masked, buff, INET6_ADDRSTRLEN);
+
+    char res[sizeof(buff) + 16];
+    snprintf(res, sizeof(res), "%s %s/%d", allow ? "allow" : "deny", buff, prefix_len);
+
+    return res;
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::acl::node::node()
+{
+    memset(child, 0, sizeof(child));
+
+    for (int i = 0; i < FANOUT; i++)
+    {
+        rule_id[i] = -1;
+    }
+}
+
+lizard::acl::acl() : default_v4(-1), default_v6(-1), allowed_num(0), denied_num(0)
+{
+    nodes_v4.push_back(node());
+    nodes_v6.push_back(node());
+}
+
+lizard::acl::~acl()
+{
+}
+
+void lizard::acl::insert(std::vector<node>& nodes, int32_t& default_rule, const uint8_t * key, int prefix_len, int32_t id)
+{
+    if (0 == prefix_len)
+    {
+        default_rule = id;
+        return;
+    }
+
+    uint32_t n = 0;
+    int depth = 0;
+
+    while (prefix_len - depth * STRIDE > STRIDE)
+    {
+        int nib = key_nibble(key, depth);
+
+        if (0 == nodes[n].child[nib])
+        {
+            nodes.push_back(node());
+            nodes[n].child[nib] = nodes.size() - 1;
+        }
+
+        n = nodes[n].child[nib];
+        depth++;
+    }
+
+    // prefix ends inside this node: expand it to all entries it covers,
+    // keeping entries already owned by a longer prefix
+    int rest = prefix_len - depth * STRIDE;
+    int base = key_nibble(key, depth) & (0xF0 >> rest) & 0x0F;
+
+    for (int i = 0; i < (1 << (STRIDE - rest)); i++)
+    {
+        int32_t& entry = nodes[n].rule_id[base | i];
+
+        if (-1 == entry || rules[entry].prefix_len <= prefix_len)
+        {
+            entry = id;
+        }
+    }
+}
+
+int32_t lizard::acl::lookup(const std::vector<node>& nodes, int32_t default_rule, const uint8_t * key, int key_len)const
+{
+    int32_t best = default_rule;
+
+    uint32_t n = 0;
+
+    for (int depth = 0; depth < key_len / STRIDE; depth++)
+    {
+        int nib = key_nibble(key, depth);
+
+        const node& nd = nodes[n];
+
+        if (-1 != nd.rule_id[nib])
+        {
+            best = nd.rule_id[nib];
+        }
+
+        n = nd.child[nib];
+
+        if (0 == n)
+        {
+            break;
+        }
+    }
+
+    return best;
+}
+
+void lizard::acl::add_rule(const char * line, int line_no)
+{
+    char action[ACL_LINE_SZ];
+    char prefix[ACL_LINE_SZ];
+
+    if (2 != sscanf(line, "%s %s", action, prefix))
+    {
+        throw error("acl line %d: expected '<allow|deny> <prefix>[/<len>]'", line_no);
+    }
+
+    rule r;
+    memset(r.addr, 0, sizeof(r.addr));
+    r.hits = 0;
+
+    if (0 == strcasecmp(action, "allow"))
+    {
+        r.allow = true;
+    }
+    else if (0 == strcasecmp(action, "deny"))
+    {
+        r.allow = false;
+    }
+    else
+    {
+        throw error("acl line %d: unknown action '%s'", line_no, action);
+    }
+
+    char * slash = strchr(prefix, '/');
+    if (slash)
+    {
+        *slash++ = 0;
+    }
+
+    if (1 == inet_pton(AF_INET, prefix, r.addr))
+    {
+        r.family = AF_INET;
+        r.prefix_len = 32;
+    }
+    else if (1 == inet_pton(AF_INET6, prefix, r.addr))
+    {
+        r.family = AF_INET6;
+        r.prefix_len = 128;
+    }
+    else
+    {
+        throw error("acl line %d: bad address '%s'", line_no, prefix);
+    }
+
+    if (slash)
+    {
+        char * end = 0;
+        long len = strtol(slash, &end, 10);
+
+        if (end == slash || *end || len < 0 || len > r.prefix_len)
+        {
+            throw error("acl line %d: bad prefix length '%s'", line_no, slash);
+        }
+
+        r.prefix_len = len;
+    }
+
+    rules.push_back(r);
+
+    int32_t id = rules.size() - 1;
+
+    if (AF_INET == r.family)
+    {
+        insert(nodes_v4, default_v4, r.addr, r.prefix_len, id);
+    }
+    else
+    {
+        insert(nodes_v6, default_v6, r.addr, r.prefix_len, id);
+    }
+}
+
+void lizard::acl::load_from_file(const char * file_name)
+{
+    FILE * fp = fopen(file_name, "r");
+    if (NULL == fp)
+    {
+        throw error("Can't open acl file \"%s\": %d: %s", file_name, errno, lizard::strerror(errno));
+    }
+
+    char line[ACL_LINE_SZ];
+    int line_no = 0;
+
+    try
+    {
+        while (fgets(line, ACL_LINE_SZ, fp))
+        {
+            line_no++;
+
+            char * comment = strchr(line, '#');
+            if (comment)
+            {
+                *comment = 0;
+            }
+
+            char * p = line;
+            while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')p++;
+
+            if (*p)
+            {
+                add_rule(p, line_no);
+            }
+        }
+    }
+    catch (...)
+    {
+        fclose(fp);
+        throw;
+    }
+
+    fclose(fp);
+
+    slogger.info("acl '%s': %d rules loaded (%d+%d trie nodes)", file_name, (int)rules.size(),
+        (int)nodes_v4.size(), (int)nodes_v6.size());
+}
+
+int lizard::acl::match(const struct sockaddr * sa)const
+{
+    if (AF_INET == sa->sa_family)
+    {
+        const struct sockaddr_in * sin = (const struct sockaddr_in *)sa;
+
+        return lookup(nodes_v4, default_v4, (const uint8_t *)&sin->sin_addr, 32);
+    }
+    else if (AF_INET6 == sa->sa_family)
+    {
+        const struct sockaddr_in6 * sin6 = (const struct sockaddr_in6 *)sa;
+
+        if (IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr))
+        {
+            return lookup(nodes_v4, default_v4, sin6->sin6_addr.s6_addr + 12, 32);
+        }
+
+        return lookup(nodes_v6, default_v6, sin6->sin6_addr.s6_addr, 128);
+    }
+
+    return -1;
+}
+
+bool lizard::acl::allowed(const struct sockaddr * sa)
+{
+    int id = match(sa);
+
+    bool ret = true;
+
+    if (-1 != id)
+    {
+        rules[id].hits++;
+        ret = rules[id].allow;
+    }
+
+    if (ret)
+    {
+        allowed_num++;
+    }
+    else
+    {
+        denied_num++;
+    }
+
+    return ret;
+}
+
+size_t lizard::acl::rules_num()const
+{
+    return rules.size();
+}
+
+const lizard::acl::rule& lizard::acl::get_rule(size_t i)const
+{
+    return rules[i];
+}
+
+uint64_t lizard::acl::get_allowed_num()const
+{
+    return allowed_num;
+}
+
+uint64_t lizard::acl::get_denied_num()const
+{
+    return denied_num;
+}
@@ -0,0 +1,298 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <algorithm>
+#include <errno.h>
+#include <lizard/affinity.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utils/error.hpp>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+// from <numaif.h>, to avoid depending on libnuma
+enum {LZ_MPOL_PREFERRED = 1};
+
+enum {CPULIST_SZ = 4096};
+
+//-----------------------------------------------------------------------------------------------------------
+
+static std::string cpus_to_string(const std::vector<int>& cpu_list)
+{
+    std::string res;
+    char buff[32];
+
+    for (size_t i = 0; i < cpu_list.size(); i++)
+    {
+        snprintf(buff, sizeof(buff), i ? ",%d" : "%d", cpu_list[i]);
+        res += buff;
+    }
+
+    return res;
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::thread_placement::thread_placement()
+{
+
+}
+
+void lizard::thread_placement::parse_cpu_list(const char * str, std::vector<int>& res)
+{
+    res.clear();
+
+    const char * p = str;
+
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == ',')p++;
+
+        if (0 == *p)
+        {
+            break;
+        }
+
+        char * end;
+
+        long from = strtol(p, &end, 10);
+        long to = from;
+
+        if (end == p || from < 0)
+        {
+            throw error("bad cpu list \"%s\"", str);
+        }
+
+        p = end;
+
+        if (*p == '-')
+        {
+            p++;
+
+            to = strtol(p, &end, 10);
+
+            if (end == p || to < from)
+            {
+                throw error("bad cpu list \"%s\"", str);
+            }
+
+            p = end;
+        }
+
+        if (*p && *p != ',' && *p != ' ' && *p != '\t' && *p != '\n')
+        {
+            throw error("bad cpu list \"%s\"", str);
+        }
+
+        if (to >= CPU_SETSIZE)
+        {
+            throw error("cpu %ld in \"%s\" is out of range", to, str);
+        }
+
+        for (long i = from; i <= to; i++)
+        {
+            res.push_back((int)i);
+        }
+    }
+
+    std::sort(res.begin(), res.end());
+    res.erase(std::unique(res.begin(), res.end()), res.end());
+}
+
+void lizard::thread_placement::init(const std::string& epoll_cpus, const std::string& easy_cpus, const std::string& hard_cpus,
+        const std::string& service_cpus, const std::string& numa_nodes)
+{
+    parse_cpu_list(epoll_cpus.c_str(),   cpus[thEpoll]);
+    parse_cpu_list(easy_cpus.c_str(),    cpus[thEasy]);
+    parse_cpu_list(hard_cpus.c_str(),    cpus[thHard]);
+    parse_cpu_list(service_cpus.c_str(), cpus[thService]);
+
+    parse_cpu_list(numa_nodes.c_str(), nodes);
+
+    node_cpus.clear();
+    node_cpus.resize(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        char path[256];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+
+        FILE * fp = fopen(path, "r");
+        if (NULL == fp)
+        {
+            throw error("NUMA node %d: can't open \"%s\": %d: %s", nodes[i], path, errno, lizard::strerror(errno));
+        }
+
+        char line[CPULIST_SZ] = "";
+        char * r = fgets(line, CPULIST_SZ, fp);
+
+        fclose(fp);
+
+        if (r)
+        {
+            parse_cpu_list(line, node_cpus[i]);
+        }
+
+        if (node_cpus[i].empty())
+        {
+            throw error("NUMA node %d has no cpus", nodes[i]);
+        }
+
+        slogger.info("NUMA node %d: cpus %s", nodes[i], cpus_to_string(node_cpus[i]).c_str());
+    }
+}
+
+bool lizard::thread_placement::empty()const
+{
+    return nodes.empty() && cpus[thEpoll].empty() && cpus[thEasy].empty() && cpus[thHard].empty() && cpus[thService].empty();
+}
+
+int lizard::thread_placement::node_of(const std::vector<int>& cpu_list)const
+{
+    if (cpu_list.empty())
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (std::binary_search(node_cpus[i].begin(), node_cpus[i].end(), cpu_list[0]))
+        {
+            return nodes[i];
+        }
+    }
+
+    return -1;
+}
+
+int lizard::thread_placement::node_of_kind(thread_kind kind)const
+{
+    if (!nodes.empty() && (thEasy == kind || thHard == kind))
+    {
+        return 1 == nodes.size() ? nodes[0] : -1;
+    }
+
+    return node_of(cpus[kind]);
+}
+
+void lizard::thread_placement::set_affinity(const char * name, const std::vector<int>& cpu_list)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (size_t i = 0; i < cpu_list.size(); i++)
+    {
+        CPU_SET(cpu_list[i], &set);
+    }
+
+    int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (0 != r)
+    {
+        slogger.error("%s: can't bind to cpus %s: %s", name, cpus_to_string(cpu_list).c_str(), lizard::strerror(r));
+    }
+    else
+    {
+        slogger.debug("%s: bound to cpus %s", name, cpus_to_string(cpu_list).c_str());
+    }
+}
+
+void lizard::thread_placement::set_mempolicy(const char * name, int node)
+{
+    unsigned long mask[4] = {0, 0, 0, 0};
+    const int bits = 8 * sizeof(unsigned long);
+
+    if (node >= 4 * bits)
+    {
+        slogger.error("%s: NUMA node %d is out of range", name, node);
+        return;
+    }
+
+    mask[node / bits] = 1UL << (node % bits);
+
+    if (0 != syscall(SYS_set_mempolicy, (int)LZ_MPOL_PREFERRED, mask, (unsigned long)(4 * bits)))
+    {
+        slogger.error("%s: can't prefer memory of NUMA node %d: %s", name, node, lizard::strerror(errno));
+    }
+    else
+    {
+        slogger.debug("%s: prefers memory of NUMA node %d", name, node);
+    }
+}
+
+void lizard::thread_placement::apply(thread_kind kind, size_t index, const char * name)const
+{
+    // thread names are limited to 16 bytes including the terminating zero
+    char short_name[16];
+    snprintf(short_name, sizeof(short_name), "%s", name);
+
+    pthread_setname_np(pthread_self(), short_name);
+
+    std::vector<int> cpu_list = cpus[kind];
+    int node = -1;
+
+    if (!nodes.empty() && (thEasy == kind || thHard == kind))
+    {
+        size_t n = index % nodes.size();
+
+        node = nodes[n];
+
+        if (cpu_list.empty())
+        {
+            cpu_list = node_cpus[n];
+        }
+        else
+        {
+            std::vector<int> common;
+            std::set_intersection(cpu_list.begin(), cpu_list.end(), node_cpus[n].begin(), node_cpus[n].end(),
+                    std::back_inserter(common));
+
+            if (common.empty())
+            {
+                slogger.warn("%s: none of cpus %s is on NUMA node %d, using all cpus of the node",
+                        name, cpus_to_string(cpu_list).c_str(), node);
+                cpu_list = node_cpus[n];
+            }
+            else
+            {
+                cpu_list.swap(common);
+            }
+        }
+    }
+    else
+    {
+        node = node_of(cpu_list);
+    }
+
+    if (!cpu_list.empty())
+    {
+        set_affinity(name, cpu_list);
+    }
+
+    if (node >= 0)
+    {
+        set_mempolicy(name, node);
+    }
+}
+
+//-----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,200 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/arena.hpp>
+#include <lizard/mem_accountant.hpp>
+#include <lizard/page_pool.hpp>
+#include <pthread.h>
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+struct chunk_cache
+{
+    void * chunks[lizard::arena::CACHE_CHUNKS];
+    int num;
+
+    chunk_cache() : num(0){}
+};
+
+__thread chunk_cache * local_cache = 0;
+
+pthread_key_t cache_key;
+pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+void release_cache(void * ptr)
+{
+    chunk_cache * c = (chunk_cache *)ptr;
+
+    while (c->num)
+    {
+        mem_pages.free(c->chunks[--c->num], lizard::arena::CHUNK_SZ);
+    }
+
+    delete c;
+}
+
+void create_cache_key()
+{
+    pthread_key_create(&cache_key, &release_cache);
+}
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::arena::arena() : head(0), allocated(0)
+{
+
+}
+
+lizard::arena::~arena()
+{
+    reset();
+}
+
+lizard::arena::chunk * lizard::arena::get_chunk(size_t sz)
+{
+    void * mem = 0;
+
+    if (CHUNK_SZ == sz && local_cache && local_cache->num)
+    {
+        mem = local_cache->chunks[--local_cache->num];
+    }
+    else
+    {
+        mem = mem_pages.allocate(sz);
+    }
+
+    chunk * c = (chunk *)mem;
+
+    if (c)
+    {
+        mem_account.add(mem_accountant::mArenas, sz);
+
+        c->next = 0;
+        c->size = sz;
+        c->used = sizeof(chunk);
+    }
+
+    return c;
+}
+
+void lizard::arena::put_chunk(chunk * c)
+{
+    mem_account.sub(mem_accountant::mArenas, c->size);
+
+    if (CHUNK_SZ == c->size)
+    {
+        if (0 == local_cache)
+        {
+            pthread_once(&cache_key_once, &create_cache_key);
+
+            local_cache = new chunk_cache;
+            pthread_setspecific(cache_key, local_cache);
+        }
+
+        if (local_cache->num < CACHE_CHUNKS)
+        {
+            local_cache->chunks[local_cache->num++] = c;
+            return;
+        }
+    }
+
+    mem_pages.free(c, c->size);
+}
+
+void * lizard::arena::alloc(size_t sz, size_t align)
+{
+    if (0 == align)
+    {
+        align = 1;
+    }
+
+    if (head)
+    {
+        uintptr_t start = ((uintptr_t)head + head->used + align - 1) & ~(uintptr_t)(align - 1);
+
+        if (start + sz <= (uintptr_t)head + head->size)
+        {
+            head->used = start + sz - (uintptr_t)head;
+            allocated += sz;
+
+            return (void *)start;
+        }
+    }
+
+    const size_t need = sizeof(chunk) + sz + align;
+
+    if (need > CHUNK_SZ / 4)
+    {
+        // a chunk of its own behind the current one, which may still have room
+        chunk * c = get_chunk(need > CHUNK_SZ ? need : (size_t)CHUNK_SZ);
+        if (0 == c)
+        {
+            return 0;
+        }
+
+        uintptr_t start = ((uintptr_t)c + sizeof(chunk) + align - 1) & ~(uintptr_t)(align - 1);
+        c->used = c->size;
+
+        if (head)
+        {
+            c->next = head->next;
+            head->next = c;
+        }
+        else
+        {
+            head = c;
+        }
+
+        allocated += sz;
+
+        return (void *)start;
+    }
+
+    chunk * c = get_chunk(CHUNK_SZ);
+    if (0 == c)
+    {
+        return 0;
+    }
+
+    c->next = head;
+    head = c;
+
+    return alloc(sz, align);
+}
+
+void lizard::arena::reset()
+{
+    while (head)
+    {
+        chunk * next = head->next;
+
+        put_chunk(head);
+
+        head = next;
+    }
+
+    allocated = 0;
+}
+
+size_t lizard::arena::get_allocated()const
+{
+    return allocated;
+}
+
+//-----------------------------------------------------------------------------------------------------------
@@ -19,6 +19,7 @@
 static lizard::Logger& slogger = lizard::getLog("lizard");
 
 enum {EPOLL_TIMEOUT = 100};
+enum {TRIM_PERIOD = 1000000}; // us
 
 //TODO: min_timeout(): we should calculate next timeout for epoll here but I decided to set it to 10ms manually for now
 
@@ -48,7 +49,7 @@ uint64_t lizard::fd_map::container::get_lifetime()const
     return (last_access > first_access) ? (last_access - first_access) : 0;
 }
 //--------------------------------------------------------------------------------
-lizard::fd_map::fd_map() : map_handle(0), timeouts(10)
+lizard::fd_map::fd_map() : map_handle(0), timeouts(10), pool_idle_time(0), last_trim(0)
 {
 }
 //--------------------------------------------------------------------------------------------------------
@@ -133,7 +134,8 @@ bool lizard::fd_map::release(http * el)
     else
     {
         //message("fds.release(%d) deferred", el->get_fd());
-        c->destroy();
+        // a worker still uses the buffers, they are reset when the task comes back
+        c->abandon();
 
         return false;
     }
@@ -185,11 +187,42 @@ void lizard::fd_map::kill_oldest(int timeout)
 
     timeouts.erase_oldest(time - timeout);
 
+    if (pool_idle_time && time - last_trim >= TRIM_PERIOD)
+    {
+        last_trim = time;
+
+        u_int32_t released = elements_pool.trim(time, pool_idle_time);
+        if (released)
+        {
+            slogger.info("connection pool: released %u idle pages", (unsigned)released);
+        }
+    }
+
     stats.objects_in_http_pool = elements_pool.allocated_objects();
     stats.pages_in_http_pool = elements_pool.allocated_pages();
 
 }
 //--------------------------------------------------------------------------------------------------------
+void lizard::fd_map::set_pool_idle_time(int seconds)
+{
+    pool_idle_time = 1000000ULL * seconds;
+}
+//--------------------------------------------------------------------------------------------------------
+void lizard::fd_map::set_page_source(pool_ns::page_source * src)
+{
+    elements_pool.set_page_source(src);
+}
+//--------------------------------------------------------------------------------------------------------
+size_t lizard::fd_map::reserve(size_t connections)
+{
+    return elements_pool.reserve((u_int32_t)connections);
+}
+//--------------------------------------------------------------------------------------------------------
+size_t lizard::fd_map::pool_page_size()
+{
+    return OBJECTS_PER_PAGE * sizeof(container);
+}
+//--------------------------------------------------------------------------------------------------------
 int lizard::fd_map::min_timeout()const
 {
     return EPOLL_TIMEOUT;
@@ -199,3 +232,24 @@ size_t lizard::fd_map::fd_count()const
 {
      return (size_t)JudyLCount(map_handle, 0, -1, 0);
 }
+//--------------------------------------------------------------------------------------------------------
+size_t lizard::fd_map::object_size()
+{
+    return sizeof(container);
+}
+//--------------------------------------------------------------------------------------------------------
+size_t lizard::fd_map::pool_depot_magazines()const
+{
+    return elements_pool.depot_magazines();
+}
+//--------------------------------------------------------------------------------------------------------
+void lizard::fd_map::get_pool_stats(std::vector<elements_pool_t::cache_stats>& res)const
+{
+    elements_pool.get_cache_stats(res);
+}
+
+//--------------------------------------------------------------------------------------------------------
+void lizard::fd_map::get_pool_occupancy(elements_pool_t::occupancy_stats& res)const
+{
+    elements_pool.get_occupancy(res);
+}
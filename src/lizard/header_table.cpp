@@ -0,0 +1,251 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/header_table.hpp>
+#include <string.h>
+#include <strings.h>
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// in the order of task::request_header_t
+const char * known_names[lizard::task::KNOWN_HEADERS_NUM] =
+{
+    "Host",
+    "Cookie",
+    "Content-Type",
+    "Content-Length",
+    "Connection",
+    "User-Agent",
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Referer",
+    "Expect",
+    "X-Forwarded-For",
+    "X-Real-IP",
+    "If-Modified-Since",
+    "Authorization",
+    "Range",
+};
+
+// open addressing over the hashes of known_names: header + 1, 0 is a free slot
+struct known_index
+{
+    enum {SLOTS = 64};
+
+    uint8_t slots[SLOTS];
+    uint32_t lengths[lizard::task::KNOWN_HEADERS_NUM];
+
+    known_index()
+    {
+        memset(slots, 0, sizeof(slots));
+
+        for (int h = 0; h < lizard::task::KNOWN_HEADERS_NUM; h++)
+        {
+            lengths[h] = strlen(known_names[h]);
+
+            uint32_t s = lizard::header_table::hash(known_names[h], lengths[h]) & (SLOTS - 1);
+
+            while (slots[s])
+            {
+                s = (s + 1) & (SLOTS - 1);
+            }
+
+            slots[s] = h + 1;
+        }
+    }
+};
+
+const known_index known_headers;
+
+bool same_key(const lizard::header_table::item& it, const char * key, size_t len, uint32_t h)
+{
+    return it.hash == h && it.key_len == len && !strncasecmp(it.key, key, len);
+}
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::header_table::header_table() : index(MIN_SLOTS, 0), indexed(0)
+{
+    memset(known, 0, sizeof(known));
+}
+
+void lizard::header_table::clear()
+{
+    if (indexed)
+    {
+        // a large index of a past request is not kept
+        index.assign(MIN_SLOTS, 0);
+    }
+
+    items.clear();
+    indexed = 0;
+
+    memset(known, 0, sizeof(known));
+}
+
+// FNV-1a over the bytes with the 0x20 bit set: letters are folded to lower
+// case, other token chars of a header name keep their hash distinct enough
+uint32_t lizard::header_table::hash(const char * key, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)(key[i] | 0x20);
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+int lizard::header_table::known_header(const char * key, size_t len, uint32_t h)
+{
+    uint32_t s = h & (known_index::SLOTS - 1);
+
+    while (known_headers.slots[s])
+    {
+        int k = known_headers.slots[s] - 1;
+
+        if (known_headers.lengths[k] == len && !strncasecmp(known_names[k], key, len))
+        {
+            return k;
+        }
+
+        s = (s + 1) & (known_index::SLOTS - 1);
+    }
+
+    return -1;
+}
+
+const char * lizard::header_table::known_name(int h)
+{
+    return (h >= 0 && h < task::KNOWN_HEADERS_NUM) ? known_names[h] : 0;
+}
+
+bool lizard::header_table::insert(uint32_t n)
+{
+    const item& it = items[n];
+
+    size_t mask = index.size() - 1;
+    size_t s = it.hash & mask;
+
+    while (index[s])
+    {
+        if (same_key(items[index[s] - 1], it.key, it.key_len, it.hash))
+        {
+            return false; // the first one is found by the key
+        }
+
+        s = (s + 1) & mask;
+    }
+
+    index[s] = n + 1;
+
+    return true;
+}
+
+void lizard::header_table::rehash(size_t slots)
+{
+    index.assign(slots, 0);
+
+    for (uint32_t n = 0; n < items.size(); n++)
+    {
+        insert(n);
+    }
+}
+
+int lizard::header_table::add(const char * key, size_t key_len, const char * value, size_t value_len)
+{
+    // at most half of the slots are taken
+    if (2 * (indexed + 1) > index.size())
+    {
+        rehash(2 * index.size());
+    }
+
+    item it;
+
+    it.key = key;
+    it.value = value;
+    it.key_len = key_len;
+    it.value_len = value_len;
+    it.hash = hash(key, key_len);
+
+    items.push_back(it);
+
+    int k = known_header(key, key_len, it.hash);
+
+    uint32_t n = items.size() - 1;
+
+    if (insert(n))
+    {
+        indexed++;
+
+        if (-1 != k)
+        {
+            known[k] = n + 1;
+        }
+    }
+
+    return k;
+}
+
+size_t lizard::header_table::size()const
+{
+    return items.size();
+}
+
+const lizard::header_table::item& lizard::header_table::operator[](size_t i)const
+{
+    return items[i];
+}
+
+const lizard::header_table::item * lizard::header_table::find(const char * key, size_t key_len)const
+{
+    uint32_t h = hash(key, key_len);
+
+    size_t mask = index.size() - 1;
+    size_t s = h & mask;
+
+    while (index[s])
+    {
+        const item& it = items[index[s] - 1];
+
+        if (same_key(it, key, key_len, h))
+        {
+            return &it;
+        }
+
+        s = (s + 1) & mask;
+    }
+
+    return 0;
+}
+
+const lizard::header_table::item * lizard::header_table::find(task::request_header_t h)const
+{
+    if (h < 0 || h >= task::KNOWN_HEADERS_NUM || !known[h])
+    {
+        return 0;
+    }
+
+    return &items[known[h] - 1];
+}
+
+//-----------------------------------------------------------------------------------------------------------
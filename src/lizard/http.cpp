@@ -12,14 +12,18 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <ctype.h>
 #include <errno.h>
 #include <lizard/Version.h>
 #include <lizard/http.hpp>
+#include <lizard/url_params.hpp>
 #include <netdb.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <sys/socket.h>
 #include <utils/logger.hpp>
 
+lizard::Logger& lizard::mem_chunk::slogger = lizard::getLog("lizard");
 lizard::Logger& lizard::mem_block::slogger = lizard::getLog("lizard");
 static lizard::Logger& slogger = lizard::getLog("lizard");
 
@@ -79,6 +83,162 @@ codes_table[] = {
 
 #define codes_table_sz (sizeof(codes_table) / sizeof(codes_table[0]))
 
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// "HTTP/1.x NNN Reason\r\nServer: ...\r\n" of the codes in codes_table, built
+// with http_codes
+enum {STATUS_LINES_MAX = 600};
+
+lizard::string_view status_lines[2][STATUS_LINES_MAX];
+
+void build_status_lines()
+{
+    for (int minor = 0; minor < 2; minor++)
+    {
+        for (uint32_t j = 0; j < codes_table_sz; j++)
+        {
+            int code = codes_table[j].code;
+
+            if (code < STATUS_LINES_MAX)
+            {
+                char buff[256];
+                int l = snprintf(buff, sizeof(buff), "HTTP/1.%d %d %s\r\nServer: lizard/" LIZARD_VERSION_STRING "\r\n",
+                        minor, code, codes_table[j].desc);
+
+                char * line = new char[l];
+                memcpy(line, buff, l);
+
+                status_lines[minor][code] = lizard::string_view(line, l);
+            }
+        }
+    }
+}
+
+#define HEADER_BLOCK(s) lizard::string_view(s, sizeof(s) - 1)
+
+// headers that depend on the cache and keep-alive flags only
+const lizard::string_view header_blocks[2][2] =
+{
+    {
+        HEADER_BLOCK("Pragma: no-cache\r\nCache-control: no-cache\r\nConnection: close\r\n"),
+        HEADER_BLOCK("Pragma: no-cache\r\nCache-control: no-cache\r\nConnection: keep-alive\r\n"),
+    },
+    {
+        HEADER_BLOCK("Connection: close\r\n"),
+        HEADER_BLOCK("Connection: keep-alive\r\n"),
+    },
+};
+
+#undef HEADER_BLOCK
+
+const char body_headers[] = "Accept-Ranges: bytes\r\nContent-Length: ";
+
+/*
+
+"Date: ...\r\n" of the current second. Any thread that sees a new second
+formats the next slot and publishes it, the others keep copying the current
+one meanwhile; a slot is written again only after all the others.
+
+*/
+enum {DATE_LINE_SZ = 37}; // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+enum {DATE_SLOTS = 4};
+
+struct date_slot
+{
+    time_t sec;
+    char   line[DATE_LINE_SZ + 1];
+};
+
+date_slot date_slots[DATE_SLOTS];
+int date_current = 0;
+int date_updating = 0;
+
+void date_line(char * to)
+{
+    time_t now = time(0);
+
+    int i = __atomic_load_n(&date_current, __ATOMIC_ACQUIRE);
+
+    if (date_slots[i].sec != now && !__atomic_exchange_n(&date_updating, 1, __ATOMIC_ACQUIRE))
+    {
+        int next = (i + 1) % DATE_SLOTS;
+
+        struct tm tm;
+        gmtime_r(&now, &tm);
+
+        strftime(date_slots[next].line, sizeof(date_slots[next].line), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        date_slots[next].sec = now;
+
+        __atomic_store_n(&date_current, next, __ATOMIC_RELEASE);
+        __atomic_store_n(&date_updating, 0, __ATOMIC_RELEASE);
+
+        i = next;
+    }
+
+    memcpy(to, date_slots[i].line, DATE_LINE_SZ);
+}
+
+// decimal digits of v, two at a time; returns their number
+size_t write_uint(char * to, uint64_t v)
+{
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+    char tmp[20];
+    char * p = tmp + sizeof(tmp);
+
+    while (v >= 100)
+    {
+        const char * d = digit_pairs + (v % 100) * 2;
+        v /= 100;
+
+        *--p = d[1];
+        *--p = d[0];
+    }
+
+    if (v >= 10)
+    {
+        *--p = digit_pairs[v * 2 + 1];
+        *--p = digit_pairs[v * 2];
+    }
+    else
+    {
+        *--p = (char)('0' + v);
+    }
+
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(to, p, n);
+
+    return n;
+}
+
+struct canned_body
+{
+    const char * data;
+    size_t size;
+};
+
+#define CANNED_BODY(s) {s, sizeof(s) - 1}
+
+// in the order of http::canned_reply
+const canned_body canned_bodies[lizard::http::CANNED_NUM] =
+{
+    CANNED_BODY("memory budget exceeded"),
+    CANNED_BODY("easy queue filled!"),
+    CANNED_BODY("hard queue filled!"),
+    CANNED_BODY("easy loop error"),
+    CANNED_BODY("hard loop error"),
+};
+
+#undef CANNED_BODY
+
+const char canned_type[] = "Content-type: text/plain\r\n";
+
+}
+
 
 enum {HTTP_CODES_MAX_SIZE = 1024};
 const char * http_codes_array[HTTP_CODES_MAX_SIZE];
@@ -86,6 +246,15 @@ const char * http_codes_array[HTTP_CODES_MAX_SIZE];
 const char ** lizard::http::http_codes = 0;
 int lizard::http::http_codes_num = 0;
 
+size_t lizard::http::read_headers_sz = 8192;
+size_t lizard::http::write_title_sz = 8192;
+size_t lizard::http::write_headers_sz = 4096;
+size_t lizard::http::write_body_sz = 32768;
+
+size_t lizard::http::post_memory_max = 1048576;
+size_t lizard::http::post_max = 67108864;
+std::string lizard::http::post_spill_dir = "/tmp";
+
 lizard::http::http() :
     fd(-1),
     want_read(false),
@@ -95,18 +264,34 @@ lizard::http::http() :
     stop_reading(false),
     stop_writing(false),
     locked(false),
+    queued_time(0),
+    hard_seq(0),
+    in_headers(read_headers_sz),
+    head_scanned(0),
+    post_len(0),
+    post_ready(false),
+    out_title(write_title_sz),
+    out_headers(write_headers_sz),
+    out_post(write_body_sz),
     state_(sUndefined),
-    header_items_num(0),
     protocol_major(0),
     protocol_minor(0),
     keep_alive(false),
     cache(false),
-    uri_path(0),
-    uri_params(0),
+    uri_path(),
+    uri_params(),
+    query_parsed(false),
+    form_parsed(false),
     response_status(0)
 {
     memset(&in_ip, 0, sizeof(in_ip));
 
+    in_headers.set_account(mem_accountant::mHeaders);
+    in_post.set_account(mem_accountant::mBodies);
+    out_title.set_account(mem_accountant::mResponses);
+    out_headers.set_account(mem_accountant::mResponses);
+    out_post.set_account(mem_accountant::mResponses);
+
     out_post.set_expand(true);
 
         if (0 == http_codes)
@@ -131,6 +316,12 @@ lizard::http::http() :
             }
         }
 
+        build_status_lines();
+
+        // the first slot is filled before any thread reads it
+        char date[DATE_LINE_SZ];
+        date_line(date);
+
         http_codes = http_codes_array;
     }
 }
@@ -171,24 +362,34 @@ void lizard::http::init(int new_fd, const struct in_addr& ip)
     stop_writing = false;
 
     locked = false;
+    queued_time = 0;
+    hard_seq = 0;
 
     state_ = sUndefined;
-    header_items_num = 0;
     protocol_major = 0;
     protocol_minor = 0;
     keep_alive = false;
     cache = false;
 
-    uri_path = 0;
-    uri_params = 0;
+    uri_path = string_view();
+    uri_params = string_view();
     response_status = 0;
 
     in_headers.reset();
-    in_post.reset();
+    in_post.resize(0);
     out_title.reset();
     out_headers.reset();
     out_post.reset();
 
+    post_len = 0;
+    post_ready = false;
+    head_scanned = 0;
+
+    in_headers.set_page_size(read_headers_sz);
+    out_title.set_page_size(write_title_sz);
+    out_headers.set_page_size(write_headers_sz);
+    out_post.set_page_size(write_body_sz);
+
     out_post.set_expand(true);
 
     state_ = sUndefined;
@@ -209,14 +410,41 @@ void lizard::http::destroy()
     }
 
     in_headers.reset();
-    in_post.reset();
+    in_post.resize(0);
     out_title.reset();
     out_headers.reset();
     out_post.reset();
 
+    req_arena.reset();
+
     state_ = sUndefined;
 }
 
+void lizard::http::set_page_sizes(size_t read_headers, size_t write_title, size_t write_headers, size_t write_body)
+{
+    read_headers_sz = read_headers;
+    write_title_sz = write_title;
+    write_headers_sz = write_headers;
+    write_body_sz = write_body;
+}
+
+void lizard::http::set_post_limits(size_t memory_max, size_t max, const std::string& spill_dir)
+{
+    post_memory_max = memory_max;
+    post_max = max;
+    post_spill_dir = spill_dir;
+}
+
+void lizard::http::abandon()
+{
+    if (-1 != fd)
+    {
+        shutdown(fd, SHUT_RDWR);
+        close(fd);
+
+        fd = -1;
+    }
+}
 
 bool lizard::http::ready_read()const
 {
@@ -292,11 +520,36 @@ void lizard::http::unlock()
     locked = false;
 }
 
+bool lizard::http::post_paused()const
+{
+    return sReadingPost == state_ && !post_ready;
+}
+
 bool lizard::http::is_locked()const
 {
     return locked;
 }
 
+void lizard::http::set_queued_time(uint64_t t)
+{
+    queued_time = t;
+}
+
+uint64_t lizard::http::get_queued_time()const
+{
+    return queued_time;
+}
+
+void lizard::http::set_hard_seq(uint64_t s)
+{
+    __atomic_store_n(&hard_seq, s, __ATOMIC_RELEASE);
+}
+
+uint64_t lizard::http::get_hard_seq()const
+{
+    return __atomic_load_n(&hard_seq, __ATOMIC_ACQUIRE);
+}
+
 lizard::http::http_state lizard::http::state()const
 {
     return state_;
@@ -333,12 +586,12 @@ struct in_addr lizard::http::get_request_ip()const
 
 const char * lizard::http::get_request_uri_path()const
 {
-    return uri_path;
+    return uri_path.data;
 }
 
 const char * lizard::http::get_request_uri_params()const
 {
-    return uri_params;
+    return uri_params.data;
 }
 
 size_t lizard::http::get_request_body_len()const
@@ -353,28 +606,96 @@ const uint8_t * lizard::http::get_request_body()const
 
 const char * lizard::http::get_request_header(const char * hk)const
 {
-    for (size_t i = 0; i < get_request_headers_num(); i++)
-    {
-        if (!strcasecmp(header_items[i].key, hk))
-            return header_items[i].value;
-    }
+    const header_table::item * it = headers.find(hk, strlen(hk));
 
-    return 0;
+    return it ? it->value : 0;
+}
+
+const char * lizard::http::get_request_header(request_header_t h)const
+{
+    const header_table::item * it = headers.find(h);
+
+    return it ? it->value : 0;
 }
 
 size_t lizard::http::get_request_headers_num()const
 {
-    return header_items_num;
+    return headers.size();
 }
 
 const char * lizard::http::get_request_header_key(int sz)const
 {
-    return header_items[sz].key;
+    return headers[sz].key;
 }
 
 const char * lizard::http::get_request_header_value(int sz)const
 {
-    return header_items[sz].value;
+    return headers[sz].value;
+}
+
+lizard::string_view lizard::http::get_request_uri_path_view()const
+{
+    return uri_path;
+}
+
+lizard::string_view lizard::http::get_request_uri_params_view()const
+{
+    return uri_params;
+}
+
+lizard::string_view lizard::http::get_request_header_view(const string_view& key)const
+{
+    const header_table::item * it = headers.find(key.data, key.size);
+
+    return it ? string_view(it->value, it->value_len) : string_view();
+}
+
+lizard::string_view lizard::http::get_request_header_view(request_header_t h)const
+{
+    const header_table::item * it = headers.find(h);
+
+    return it ? string_view(it->value, it->value_len) : string_view();
+}
+
+lizard::string_view lizard::http::get_request_header_key_view(int sz)const
+{
+    return string_view(headers[sz].key, headers[sz].key_len);
+}
+
+lizard::string_view lizard::http::get_request_header_value_view(int sz)const
+{
+    return string_view(headers[sz].value, headers[sz].value_len);
+}
+
+const lizard::request_params& lizard::http::get_request_query()
+{
+    if (!query_parsed)
+    {
+        query_parsed = parse_params(uri_params.data, uri_params.size, req_arena, query);
+    }
+
+    return query;
+}
+
+const lizard::request_params& lizard::http::get_request_form()
+{
+    if (!form_parsed)
+    {
+        static const char form_type[] = "application/x-www-form-urlencoded";
+
+        string_view type = get_request_header_view(headerContentType);
+
+        if (type.size >= sizeof(form_type) - 1 && !strncasecmp(type.data, form_type, sizeof(form_type) - 1))
+        {
+            form_parsed = parse_params((const char *)in_post.get_data(), in_post.size(), req_arena, form);
+        }
+        else
+        {
+            form_parsed = true;
+        }
+    }
+
+    return form;
 }
 
 void lizard::http::set_keepalive(bool st)
@@ -405,6 +726,19 @@ void lizard::http::append_response_body(const char * data, size_t sz)
     out_post.append_data(data, sz);
 }
 
+void lizard::http::set_canned_reply(canned_reply r)
+{
+    response_status = 503;
+
+    out_headers.append_data(canned_type, sizeof(canned_type) - 1);
+    out_post.append_data(canned_bodies[r].data, canned_bodies[r].size);
+}
+
+void * lizard::http::alloc(size_t sz, size_t align)
+{
+    return req_arena.alloc(sz, align);
+}
+
 void lizard::http::process()
 {
     //slogger.debug("lizard::http::process()");
@@ -427,28 +761,11 @@ void lizard::http::process()
 
         case sReadingHead:
             //slogger.debug("lizard::http::process(): sReadingHead");
-            res = parse_title();
+            res = parse_head();
 
             if (res > 0)
             {
-                //slogger.debug("process():  parse_title() error %d", res);
-                state_ = sDone;
-                quit = true;
-            }
-            else if (res < 0)
-            {
-                quit = true;
-            }
-
-            break;
-
-        case sReadingHeaders:
-            //slogger.debug("lizard::http::process(): sReadingHeaders");
-            res = parse_header_line();
-
-            if (res > 0)
-            {
-                //slogger.debug("process():  parse_header_line() error %d", res);
+                //slogger.debug("process():  parse_head() error %d", res);
                 state_ = sDone;
                 quit = true;
             }
@@ -592,111 +909,63 @@ int lizard::http::write_data()
     {
         state_ = sDone;
 
+        out_title.reset();
+        out_post.reset();
+
         return 0;
     }
 }
 
-char * lizard::http::read_header_line()
+int lizard::http::parse_head()
 {
-    while (true)
-    {
-        want_read = true;
+    want_read = true;
 
-        if (!network_tryread())
-        {
-            break;
-        }
+    if (!network_tryread())
+    {
+        return -1;
+    }
 
-        char * headers_data = (char*)in_headers.get_data();
-        headers_data[in_headers.get_data_size()] = 0;
+    if (in_headers.empty())
+    {
+        return -1; // nothing has arrived yet
+    }
 
-        char * begin = headers_data + in_headers.marker();
+    char * buf = (char*)in_headers.get_data();
+    size_t sz = in_headers.get_data_size();
 
-        char * nl = strchr(begin, '\n');
+    // usually the whole head comes with the first read and is scanned at
+    // once; a head that comes in parts is scanned when its end arrives
+    int status = -1;
 
-        if (nl)
-        {
-            in_headers.marker() = nl - headers_data + 1;
+    if (0 == head_scanned || http_scan::find_head_end(buf, sz, head_scanned))
+    {
+        status = http_scan::scan_head(buf, sz, head);
+    }
 
-            *nl = 0;
-            nl--;
-            if (*nl == '\r')
-            {
-                *nl = 0;
-            }
+    if (-1 == status)
+    {
+        head_scanned = sz;
 
-            return begin;
-        }
-        else if (!can_read || stop_reading)
-        {
-            break;
-        }
-        else //can read && !want_read && !stop_reading
+        if (can_read && !stop_reading)
         {
             //slogger.message_r(LOG_ERROR, "header is larger than %d", (int)in_headers.page_size());
             state_ = sDone;
-            break;
         }
-    }
 
-    return 0;
-}
-
-int lizard::http::parse_title()
-{
-    //slogger.debug("parse_title()");
-    char * line = read_header_line();
-    if (!line)
-    {
-        //slogger.debug("got 0");
         return -1;
     }
 
-    //slogger.debug("read_header_line() = '%s'", line);
-
     state_ = sDone;
 
-    char * mthd = line;
-
-    while (*mthd == ' ')mthd++;
-
-    char * url = strchr(mthd, ' ');
-    if (!url)
-    {
-        return 400;
-    }
-
-    while (*url == ' ')*url++ = 0;
-
-    char * version = strchr(url, ' ');
-    if (!version)
-    {
-        return 400;
-    }
-
-    while (*version == ' ')*version++ = 0;
-
-    if (strncasecmp(version, "HTTP/", 5))
+    if (status)
     {
-        return 400;
+        return status;
     }
 
-    version += 5;
-    char * mnr = strchr(version, '.');
-    if (!mnr)
-    {
-        return 400;
-    }
+    // the body starts after the head
+    in_headers.marker() = head.length;
 
-    char * delim = strchr(url, '?');
-    if (!delim)
-    {
-        delim = url - 1;
-    }
-    else
-    {
-        *delim++ = 0;
-    }
+    char * mthd = buf + head.method.off;
 
     switch(mthd[0])
     {
@@ -730,82 +999,103 @@ int lizard::http::parse_title()
             return 501;
     }
 
-    protocol_major = atoi(version);
-    protocol_minor = atoi(mnr + 1);
+    // the parts become C strings in place
+    buf[head.method.off + head.method.len] = 0;
+    buf[head.uri_path.off + head.uri_path.len] = 0;
+    buf[head.uri_params.off + head.uri_params.len] = 0;
+    buf[head.version.off + head.version.len] = 0;
 
-    uri_path = url;
-    uri_params = delim;
+    char * version = buf + head.version.off;
 
-    state_ = sReadingHeaders;
+    protocol_major = atoi(version);
+    protocol_minor = atoi(strchr(version, '.') + 1);
 
-    return 0;
-}
+    uri_path = string_view(buf + head.uri_path.off, head.uri_path.len);
+    uri_params = string_view(buf + head.uri_params.off, head.uri_params.len);
 
-int lizard::http::parse_header_line()
-{
-    //slogger.debug("parse_header_line()");
-    char * key = read_header_line();
-    if (!key)
+    for (size_t i = 0; i < head.fields.size(); i++)
     {
-        return -1;
-    }
+        const http_head::field& f = head.fields[i];
 
-    slogger.debug("read_header_line() = '%s'", key);
+        char * key = buf + f.key.off;
+        char * val = buf + f.value.off;
 
-    if (0 == *key)
-    {
-        if (method == requestPOST)
-        {
-            state_ = sReadingPost;
-            slogger.debug("->sReadingPost");
+        key[f.key.len] = 0;
+        val[f.value.len] = 0;
 
-            in_post.append_data((char*)in_headers.get_data() + in_headers.marker(), in_headers.get_data_size() - in_headers.marker());
-        }
-        else
+        if (0 == f.key.len)
         {
-            state_ = sReadyToHandle;
-
-            slogger.debug("->sReadyToHandle");
+            continue;
         }
 
-        return 0;
-    }
+        int known = headers.add(key, f.key.len, val, f.value.len);
 
-    state_ = sDone;
+        slogger.debug("headers['%s']='%s'", key, val);
 
-    while (*key == ' ')key++;
-    char * val = strchr(key, ':');
-    if (!val)
-    {
-        return 400;
+        if (-1 != known)
+        {
+            status = parse_header(known, val);
+            if (status)
+            {
+                return status;
+            }
+        }
     }
 
-    *val++ = 0;
-    while (*val == ' ')val++;
-
-    if (header_items_num < MAX_HEADER_ITEMS && *key)
+    if (method == requestPOST)
     {
-         header_items[header_items_num].key = key;
-        header_items[header_items_num].value = val;
-
-        header_items_num++;
-
-        slogger.debug("header_items['%s']='%s'", key, val);
+        state_ = sReadingPost;
+        slogger.debug("->sReadingPost");
+    }
+    else
+    {
+        state_ = sReadyToHandle;
 
+        slogger.debug("->sReadyToHandle");
     }
 
-    if (!strcasecmp(key, "connection") && !strcmp(val, "keep-alive"))
+    return 0;
+}
+
+// a well-known header the server itself looks at
+int lizard::http::parse_header(int known, char * val)
+{
+    if (known == headerConnection && !strcmp(val, "keep-alive"))
     {
         keep_alive = false;
     }
-    else if (!strncasecmp(key, "content-len", 11))
+    else if (known == headerContentLength)
     {
-        int sz = atoi(val);
-        in_post.resize(sz);
+        char * end = 0;
+        unsigned long long sz = strtoull(val, &end, 10);
+
+        while (end && *end == ' ')end++;
+
+        if (!isdigit((unsigned char)*val) || end == val || *end)
+        {
+            state_ = sDone;
+            response_status = 400;
+
+            return 400;
+        }
+
+        if (sz > post_max)
+        {
+            slogger.warn("%d: request body of %llu bytes is over the limit of %llu", fd, sz, (unsigned long long)post_max);
 
-        slogger.debug("post body found (%d bytes)", sz);
+            reply_error(413);
+
+            state_ = sDone;
+            response_status = 413;
+
+            return 413;
+        }
+
+        post_len = sz;
+
+        slogger.debug("post body found (%llu bytes)", sz);
     }
-    else if (!strcasecmp(key, "expect") && !strcasecmp(val, "100-continue")) //EVIL HACK for answering on "Expect: 100-continue"
+    else if (known == headerExpect && !strcasecmp(val, "100-continue")) //EVIL HACK for answering on "Expect: 100-continue"
     {
         const char * ret_str = "HTTP/1.1 100 Continue\r\n\r\n";
         int ret_str_sz = 25;//strlen(ret_str);
@@ -817,19 +1107,58 @@ int lizard::http::parse_header_line()
         }
     }
 
-    state_ = sReadingHeaders;
-
     return 0;
 }
 
 int lizard::http::parse_post()
 {
+    if (!post_ready)
+    {
+        if (post_len > post_memory_max)
+        {
+            if (!in_post.resize_to_file(post_len, post_spill_dir.c_str()))
+            {
+                reply_error(500);
+
+                response_status = 500;
+                state_ = sDone;
+
+                return -1;
+            }
+
+            slogger.debug("%d: post body of %lu bytes goes to a file", fd, (unsigned long)post_len);
+        }
+        else if (post_len && mem_account.get_level() >= mem_accountant::lvNoBodies)
+        {
+            // the server resumes the connection when the budget allows
+            return -1;
+        }
+        else
+        {
+            in_post.resize(post_len);
+        }
+
+        post_ready = true;
+
+        in_post.append_data((char*)in_headers.get_data() + in_headers.marker(), in_headers.get_data_size() - in_headers.marker());
+    }
+
     slogger.debug("parse_post() (%d bytes)", (int)in_post.size());
 
     in_post.read_from_fd(fd, can_read, want_read, stop_reading);
 
     if (in_post.size() == in_post.capacity())
     {
+        if (!in_post.seal())
+        {
+            reply_error(500);
+
+            response_status = 500;
+            state_ = sDone;
+
+            return -1;
+        }
+
         state_ = sReadyToHandle;
     }
 
@@ -842,17 +1171,29 @@ int lizard::http::parse_post()
     return -1;
 }
 
-int lizard::http::commit()
+void lizard::http::reply_error(int status)
 {
-    char buff[1024];
+    // nothing has been written for this request: answer right away and let
+    // the connection close
+    const char * status_str = (status < http_codes_num && http_codes[status]) ? http_codes[status] : "Error";
+
+    char resp[256];
+    int len = snprintf(resp, sizeof(resp), "HTTP/%d.%d %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+            protocol_major, protocol_minor, status, status_str);
+
+    if (send(fd, resp, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+    {
+        slogger.debug("%d: %d is not sent completely", fd, status);
+    }
+}
 
-    char now_str[128];
-    time_t now_time;
-    time(&now_time);
-    memset(now_str, 0, 128);
-    strftime(now_str, 127, "%a, %d %b %Y %H:%M:%S GMT", gmtime(&now_time));
+int lizard::http::commit()
+{
+    char buff[512];
+    char * p = buff;
 
-        const char * resp_status_str = "Unknown";
+    const char * resp_status_str = "Unknown";
+    bool prebuilt = false;
 
     if (response_status >= http_codes_num || response_status == 0)
     {
@@ -860,51 +1201,88 @@ int lizard::http::commit()
     }
     else
     {
-             resp_status_str = http_codes[response_status];
+        resp_status_str = http_codes[response_status];
+        prebuilt = response_status < STATUS_LINES_MAX && 1 == protocol_major && (0 == protocol_minor || 1 == protocol_minor);
     }
 
+    lizard::string_view line;
 
-    int l = snprintf(buff, 1023,
-            "HTTP/%d.%d %d %s\r\n"
-            "Server: lizard/" LIZARD_VERSION_STRING "\r\n"
-            "Date: %s\r\n",
-               protocol_major, protocol_minor, response_status, resp_status_str, now_str);
-
-    out_title.append_data(buff, l);
-
-    if (!cache)
+    if (prebuilt)
     {
-        const char m[] = "Pragma: no-cache\r\nCache-control: no-cache\r\n";
-        out_headers.append_data(m, sizeof(m) - 1);
-
-        //set_response_header("Pragma", "no-cache");
-        //set_response_header("Cache-control", "no-cache");
+        line = status_lines[protocol_minor][response_status]; // empty for the codes out of codes_table
     }
 
-    if (keep_alive)
+    if (line.data)
     {
-        set_response_header("Connection", "keep-alive");
+        memcpy(p, line.data, line.size);
+        p += line.size;
     }
     else
     {
-        set_response_header("Connection", "close");
+        p += snprintf(p, 256, "HTTP/%d.%d %d %s\r\nServer: lizard/" LIZARD_VERSION_STRING "\r\n",
+                protocol_major, protocol_minor, response_status, resp_status_str);
+    }
+
+    date_line(p);
+    p += DATE_LINE_SZ;
+
+    out_title.append_data(buff, p - buff);
+
+    // headers of the handler
+    if (out_headers.get_data_size())
+    {
+        out_title.append_data(out_headers.get_data(), out_headers.get_data_size());
+        out_headers.reset();
     }
 
+    const lizard::string_view& block = header_blocks[cache ? 1 : 0][keep_alive ? 1 : 0];
+
+    p = buff;
+
+    memcpy(p, block.data, block.size);
+    p += block.size;
+
     if (out_post.get_data_size())
     {
-        set_response_header("Accept-Ranges", "bytes");
+        memcpy(p, body_headers, sizeof(body_headers) - 1);
+        p += sizeof(body_headers) - 1;
 
-        l = snprintf(buff, 1023, "Content-Length: %d\r\n", (int)out_post.get_total_data_size());
-        out_headers.append_data(buff, l);
+        p += write_uint(p, out_post.get_total_data_size());
+
+        *p++ = '\r';
+        *p++ = '\n';
     }
 
-    out_headers.append_data("\r\n", 2);
+    *p++ = '\r';
+    *p++ = '\n';
 
-    out_title.append_data(out_headers.get_data(), out_headers.get_data_size());
+    out_title.append_data(buff, p - buff);
 
-    //slogger.debug("out_headers:---\n%s\n---", (char*)out_headers.get_data());
+    release_request();
 
     return 0;
 }
 
+void lizard::http::release_request()
+{
+    // the handlers are done with the request, its strings point into in_headers
+    uri_path = string_view();
+    uri_params = string_view();
+    headers.clear();
+
+    query = request_params();
+    form = request_params();
+    query_parsed = false;
+    form_parsed = false;
+
+    in_headers.reset();
+    in_post.resize(0);
+
+    post_len = 0;
+    post_ready = false;
+    head_scanned = 0;
+
+    req_arena.reset();
+}
+
 //-------------------------------------------------------------------------------------------------------------------
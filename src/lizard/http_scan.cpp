@@ -0,0 +1,211 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "http_scan_impl.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LZ_SCAN_X86 1
+#endif
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+// eight bytes at a time in a plain register
+struct scalar_classifier
+{
+    enum {WORDS = lizard::http_scan::BLOCK_SZ / 8};
+
+    static uint64_t load(const char * p)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        w = __builtin_bswap64(w);
+#endif
+        return w;
+    }
+
+    // a bit per byte of w equal to c
+    static uint32_t equal(uint64_t w, char c)
+    {
+        const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+
+        uint64_t x = w ^ (0x0101010101010101ULL * (uint8_t)c);
+        uint64_t zero = ~(((x & low7) + low7) | x | low7);
+
+        // gathers the high bits of the bytes into the top byte
+        return (uint32_t)(((zero >> 7) * 0x0102040810204080ULL) >> 56);
+    }
+
+    static uint32_t newlines(const char * p)
+    {
+        uint32_t m = 0;
+
+        for (int i = 0; i < WORDS; i++)
+        {
+            m |= equal(load(p + i * 8), '\n') << (i * 8);
+        }
+
+        return m;
+    }
+
+    static void classify(const char * p, uint32_t& newlines, uint32_t& colons, uint32_t& delims)
+    {
+        newlines = 0;
+        colons = 0;
+        delims = 0;
+
+        for (int i = 0; i < WORDS; i++)
+        {
+            uint64_t w = load(p + i * 8);
+
+            newlines |= equal(w, '\n') << (i * 8);
+            colons |= equal(w, ':') << (i * 8);
+            delims |= (equal(w, ' ') | equal(w, '?')) << (i * 8);
+        }
+    }
+};
+
+size_t find_head_end_scalar(const char * buf, size_t len, size_t from)
+{
+    return lizard::http_scan::find_head_end_impl<scalar_classifier>(buf, len, from);
+}
+
+int scan_head_scalar(const char * buf, size_t len, lizard::http_head& res)
+{
+    return lizard::http_scan::scan_head_impl<scalar_classifier>(buf, len, res);
+}
+
+struct impl_entry
+{
+    const char * name;
+
+    size_t (*find_head_end)(const char * buf, size_t len, size_t from);
+    int (*scan_head)(const char * buf, size_t len, lizard::http_head& res);
+};
+
+#ifdef LZ_SCAN_X86
+const impl_entry impls[lizard::http_scan::IMPLS_NUM] =
+{
+    {"scalar", &find_head_end_scalar, &scan_head_scalar},
+    {"sse4.2", &lizard::http_scan::find_head_end_sse42, &lizard::http_scan::scan_head_sse42},
+    {"avx2",   &lizard::http_scan::find_head_end_avx2, &lizard::http_scan::scan_head_avx2},
+};
+#else
+const impl_entry impls[lizard::http_scan::IMPLS_NUM] =
+{
+    {"scalar", &find_head_end_scalar, &scan_head_scalar},
+    {"sse4.2", 0, 0},
+    {"avx2",   0, 0},
+};
+#endif
+
+// chosen at the first call, any thread would choose the same
+int active_impl = -1;
+
+int current_impl()
+{
+    int i = __atomic_load_n(&active_impl, __ATOMIC_RELAXED);
+
+    if (-1 == i)
+    {
+        i = lizard::http_scan::implScalar;
+
+        for (int j = lizard::http_scan::IMPLS_NUM - 1; j > lizard::http_scan::implScalar; j--)
+        {
+            if (lizard::http_scan::supported(j))
+            {
+                i = j;
+                break;
+            }
+        }
+
+        __atomic_store_n(&active_impl, i, __ATOMIC_RELAXED);
+    }
+
+    return i;
+}
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+void lizard::http_scan::set_fields(http_head& res, const http_head::field * fields, size_t num, bool append)
+{
+    if (!append)
+    {
+        res.fields.clear();
+    }
+
+    res.fields.insert(res.fields.end(), fields, fields + num);
+}
+
+size_t lizard::http_scan::find_head_end(const char * buf, size_t len, size_t from)
+{
+    return impls[current_impl()].find_head_end(buf, len, from);
+}
+
+int lizard::http_scan::scan_head(const char * buf, size_t len, http_head& res)
+{
+    return impls[current_impl()].scan_head(buf, len, res);
+}
+
+int lizard::http_scan::get_impl()
+{
+    return current_impl();
+}
+
+bool lizard::http_scan::supported(int i)
+{
+    switch (i)
+    {
+    case implScalar:
+        return true;
+
+#ifdef LZ_SCAN_X86
+    case implSSE42:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+
+    case implAVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+
+    default:
+        return false;
+    }
+}
+
+bool lizard::http_scan::set_impl(int i)
+{
+    if (!supported(i))
+    {
+        return false;
+    }
+
+    __atomic_store_n(&active_impl, i, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+const char * lizard::http_scan::impl_name(int i)
+{
+    return (i >= 0 && i < IMPLS_NUM) ? impls[i].name : "unknown";
+}
+
+//-----------------------------------------------------------------------------------------------------------
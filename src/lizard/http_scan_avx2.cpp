@@ -0,0 +1,64 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compiled with -mavx2, called only when the cpu has it
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include "http_scan_impl.hpp"
+#include <immintrin.h>
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+struct avx2_classifier
+{
+    static uint32_t newlines(const char * p)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    }
+
+    static void classify(const char * p, uint32_t& newlines, uint32_t& colons, uint32_t& delims)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+
+        __m256i d = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('?')));
+
+        newlines = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        colons = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')));
+        delims = (uint32_t)_mm256_movemask_epi8(d);
+    }
+};
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+size_t lizard::http_scan::find_head_end_avx2(const char * buf, size_t len, size_t from)
+{
+    return find_head_end_impl<avx2_classifier>(buf, len, from);
+}
+
+int lizard::http_scan::scan_head_avx2(const char * buf, size_t len, http_head& res)
+{
+    return scan_head_impl<avx2_classifier>(buf, len, res);
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,278 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LIZARD_HTTP_SCAN_IMPL_HPP__
+#define __LIZARD_HTTP_SCAN_IMPL_HPP__
+
+// Shared by the http_scan translation units, each of them is compiled for
+// its own instruction set and instantiates the walkers with its classifier:
+//
+//     static uint32_t newlines(const char * p);
+//     static void classify(const char * p, uint32_t& newlines, uint32_t& colons, uint32_t& delims);
+//
+// take 32 bytes and return bit masks of '\n', of ':' and of ' ' and '?'.
+//
+// The walkers collect fields in batches and leave the std::vector to
+// http_scan.cpp: template code of the library instantiated under -mavx2
+// might be the copy the linker keeps.
+
+#include <lizard/http_scan.hpp>
+#include <string.h>
+#include <strings.h>
+
+namespace lizard
+{
+namespace http_scan
+{
+
+enum {BLOCK_SZ = 32};
+
+enum {FIELDS_BATCH = 32};
+
+void set_fields(http_head& res, const http_head::field * fields, size_t num, bool append);
+
+size_t find_head_end_sse42(const char * buf, size_t len, size_t from);
+int scan_head_sse42(const char * buf, size_t len, http_head& res);
+
+size_t find_head_end_avx2(const char * buf, size_t len, size_t from);
+int scan_head_avx2(const char * buf, size_t len, http_head& res);
+
+namespace
+{
+
+inline http_span make_span(size_t from, size_t to)
+{
+    http_span s;
+    s.off = (uint32_t)from;
+    s.len = (uint32_t)(to - from);
+
+    return s;
+}
+
+// the last block is copied to a zero padded buffer, no load crosses the end
+inline const char * block_at(const char * buf, size_t len, size_t pos, char * tail)
+{
+    if (len - pos >= BLOCK_SZ)
+    {
+        return buf + pos;
+    }
+
+    memset(tail, 0, BLOCK_SZ);
+    memcpy(tail, buf + pos, len - pos);
+
+    return tail;
+}
+
+template <class C>
+inline size_t find_head_end_impl(const char * buf, size_t len, size_t from)
+{
+    char tail[BLOCK_SZ];
+
+    for (size_t pos = from; pos < len; pos += BLOCK_SZ)
+    {
+        uint32_t m = C::newlines(block_at(buf, len, pos, tail));
+
+        while (m)
+        {
+            size_t p = pos + __builtin_ctz(m);
+            m &= m - 1;
+
+            if (p >= 1 && (buf[p - 1] == '\n' || (p >= 2 && buf[p - 1] == '\r' && buf[p - 2] == '\n')))
+            {
+                return p + 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// bits of a block at and after 'from'
+inline uint32_t bits_from(size_t from, size_t pos)
+{
+    if (from <= pos)
+    {
+        return ~0u;
+    }
+
+    return (from - pos < BLOCK_SZ) ? ~0u << (from - pos) : 0;
+}
+
+template <class C>
+inline int scan_head_impl(const char * buf, size_t len, http_head& res)
+{
+    enum {stMethod, stUri, stVersion, stHeaders};
+
+    const size_t NONE = (size_t)-1;
+
+    int st = stMethod;
+
+    size_t line = 0;       // start of the current line
+    size_t cur = 0;        // start of the current request line token
+    size_t query = NONE;   // '?' of the uri
+    size_t colon = NONE;   // first ':' of the current header line
+
+    http_head::field fields[FIELDS_BATCH];
+    size_t fields_num = 0;
+    bool append = false;
+
+    char tail[BLOCK_SZ];
+
+    for (size_t pos = 0; pos < len; pos += BLOCK_SZ)
+    {
+        uint32_t nl, colons, delims;
+        C::classify(block_at(buf, len, pos, tail), nl, colons, delims);
+
+        if (st != stHeaders)
+        {
+            // the request line: spaces between the tokens and the '?' of the uri
+            uint32_t m = nl | delims;
+
+            while (m)
+            {
+                size_t p = pos + __builtin_ctz(m);
+                m &= m - 1;
+
+                const char c = buf[p];
+
+                if ('\n' == c)
+                {
+                    size_t end = (p > 0 && buf[p - 1] == '\r') ? p - 1 : p;
+
+                    // both the method and the uri are found only with the version
+                    if (st != stVersion || end < cur + 5 || strncasecmp(buf + cur, "HTTP/", 5) ||
+                            !memchr(buf + cur + 5, '.', end - cur - 5))
+                    {
+                        return 400;
+                    }
+
+                    res.version = make_span(cur + 5, end);
+
+                    st = stHeaders;
+                    line = p + 1;
+
+                    break;
+                }
+                else if (' ' == c)
+                {
+                    if (p == cur)
+                    {
+                        cur++; // spaces before a token
+                    }
+                    else if (st == stMethod)
+                    {
+                        res.method = make_span(cur, p);
+
+                        st = stUri;
+                        cur = p + 1;
+                    }
+                    else if (st == stUri)
+                    {
+                        if (NONE == query)
+                        {
+                            res.uri_path = make_span(cur, p);
+                            res.uri_params = make_span(p, p);
+                        }
+                        else
+                        {
+                            res.uri_path = make_span(cur, query);
+                            res.uri_params = make_span(query + 1, p);
+                        }
+
+                        st = stVersion;
+                        cur = p + 1;
+                    }
+                }
+                else if (st == stUri && NONE == query)
+                {
+                    query = p;
+                }
+            }
+
+            if (st != stHeaders)
+            {
+                continue;
+            }
+
+            nl &= bits_from(line, pos);
+        }
+
+        // header lines: a line end and the first colon before it
+        while (true)
+        {
+            if (NONE == colon)
+            {
+                uint32_t cm = colons & bits_from(line, pos);
+
+                if (cm)
+                {
+                    colon = pos + __builtin_ctz(cm);
+                }
+            }
+
+            if (!nl)
+            {
+                break;
+            }
+
+            size_t p = pos + __builtin_ctz(nl);
+            nl &= nl - 1;
+
+            size_t end = (p > line && buf[p - 1] == '\r') ? p - 1 : p;
+
+            if (end == line)
+            {
+                set_fields(res, fields, fields_num, append);
+
+                res.length = (uint32_t)(p + 1); // the empty line
+                return 0;
+            }
+
+            if (NONE == colon || colon > p)
+            {
+                return 400;
+            }
+
+            size_t key = line;
+            while (key < colon && buf[key] == ' ')key++;
+
+            size_t val = colon + 1;
+            while (val < end && buf[val] == ' ')val++;
+
+            if (FIELDS_BATCH == fields_num)
+            {
+                set_fields(res, fields, fields_num, append);
+
+                fields_num = 0;
+                append = true;
+            }
+
+            fields[fields_num].key = make_span(key, colon);
+            fields[fields_num].value = make_span(val, end);
+            fields_num++;
+
+            line = p + 1;
+            colon = NONE;
+        }
+    }
+
+    return -1;
+}
+
+}
+
+}
+}
+
+#endif
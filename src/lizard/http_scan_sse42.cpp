@@ -0,0 +1,78 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// compiled with -msse4.2, called only when the cpu has it
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include "http_scan_impl.hpp"
+#include <nmmintrin.h>
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+enum {CMP_MODE = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK};
+
+struct sse42_classifier
+{
+    static uint32_t equal(__m128i lo, __m128i hi, char c)
+    {
+        const __m128i v = _mm_set1_epi8(c);
+
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lo, v)) | ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(hi, v)) << 16);
+    }
+
+    // pcmpestrm matches a set of up to 16 bytes at once
+    static uint32_t any_of(__m128i set, int set_len, __m128i v)
+    {
+        return (uint32_t)_mm_cvtsi128_si32(_mm_cmpestrm(set, set_len, v, 16, CMP_MODE)) & 0xffff;
+    }
+
+    static uint32_t newlines(const char * p)
+    {
+        return equal(_mm_loadu_si128((const __m128i *)p), _mm_loadu_si128((const __m128i *)(p + 16)), '\n');
+    }
+
+    static void classify(const char * p, uint32_t& newlines, uint32_t& colons, uint32_t& delims)
+    {
+        const __m128i delim_set = _mm_setr_epi8(' ', '?', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+        __m128i lo = _mm_loadu_si128((const __m128i *)p);
+        __m128i hi = _mm_loadu_si128((const __m128i *)(p + 16));
+
+        newlines = equal(lo, hi, '\n');
+        colons = equal(lo, hi, ':');
+        delims = any_of(delim_set, 2, lo) | (any_of(delim_set, 2, hi) << 16);
+    }
+};
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+size_t lizard::http_scan::find_head_end_sse42(const char * buf, size_t len, size_t from)
+{
+    return find_head_end_impl<sse42_classifier>(buf, len, from);
+}
+
+int lizard::http_scan::scan_head_sse42(const char * buf, size_t len, http_head& res)
+{
+    return scan_head_impl<sse42_classifier>(buf, len, res);
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+#endif
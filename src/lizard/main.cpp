@@ -27,6 +27,7 @@ namespace lizard {
 volatile sig_atomic_t quit   = 0;
 volatile sig_atomic_t hup    = 0;
 volatile sig_atomic_t rotate = 0;
+volatile sig_atomic_t reload_acl = 0;
 
 } /* namespace lizard */
 
@@ -56,6 +57,11 @@ static void onUSR1(int /*v*/)
     lizard::rotate = 1;
 }
 
+static void onUSR2(int /*v*/)
+{
+    lizard::reload_acl = 1;
+}
+
 int main(int argc, char * argv[])
 {
     //-----------------------------------------------
@@ -82,7 +88,7 @@ int main(int argc, char * argv[])
     signal(SIGPIPE, onPipe);
     signal(SIGCHLD, SIG_IGN);
     signal(SIGUSR1, onUSR1);
-    signal(SIGUSR2, SIG_IGN);
+    signal(SIGUSR2, onUSR2);
 
     try
     {
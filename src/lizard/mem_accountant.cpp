@@ -0,0 +1,137 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/mem_accountant.hpp>
+
+lizard::mem_accountant mem_account;
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::mem_accountant::mem_accountant() : budget(0)
+{
+    for (int i = 0; i < EVENTS_NUM; i++)
+    {
+        events[i] = 0;
+    }
+}
+
+void lizard::mem_accountant::init(size_t budget_bytes)
+{
+    budget = budget_bytes;
+}
+
+void lizard::mem_accountant::add(int cat, size_t sz)
+{
+    if (cat < 0 || cat >= CATEGORIES_NUM)
+    {
+        return;
+    }
+
+    counter& c = counters[cat];
+
+    int64_t now = __atomic_add_fetch(&c.bytes, (int64_t)sz, __ATOMIC_RELAXED);
+    int64_t p = __atomic_load_n(&c.peak, __ATOMIC_RELAXED);
+
+    while (now > p && !__atomic_compare_exchange_n(&c.peak, &p, now, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void lizard::mem_accountant::sub(int cat, size_t sz)
+{
+    if (cat < 0 || cat >= CATEGORIES_NUM)
+    {
+        return;
+    }
+
+    __atomic_sub_fetch(&counters[cat].bytes, (int64_t)sz, __ATOMIC_RELAXED);
+}
+
+size_t lizard::mem_accountant::used()const
+{
+    int64_t res = 0;
+
+    for (int i = 0; i < CATEGORIES_NUM; i++)
+    {
+        res += __atomic_load_n(&counters[i].bytes, __ATOMIC_RELAXED);
+    }
+
+    return res > 0 ? (size_t)res : 0;
+}
+
+size_t lizard::mem_accountant::used(int cat)const
+{
+    int64_t res = __atomic_load_n(&counters[cat].bytes, __ATOMIC_RELAXED);
+
+    return res > 0 ? (size_t)res : 0;
+}
+
+size_t lizard::mem_accountant::peak(int cat)const
+{
+    return (size_t)__atomic_load_n(&counters[cat].peak, __ATOMIC_RELAXED);
+}
+
+size_t lizard::mem_accountant::get_budget()const
+{
+    return budget;
+}
+
+int lizard::mem_accountant::get_level()const
+{
+    if (0 == budget)
+    {
+        return lvNormal;
+    }
+
+    size_t u = used();
+
+    if (u >= budget)
+    {
+        return lvShed;
+    }
+    else if (u >= budget / 100 * NO_ACCEPT_PCT)
+    {
+        return lvNoAccept;
+    }
+    else if (u >= budget / 100 * NO_BODIES_PCT)
+    {
+        return lvNoBodies;
+    }
+
+    return lvNormal;
+}
+
+void lizard::mem_accountant::report(event ev)
+{
+    __atomic_add_fetch(&events[ev], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t lizard::mem_accountant::get_events(event ev)const
+{
+    return __atomic_load_n(&events[ev], __ATOMIC_RELAXED);
+}
+
+const char * lizard::mem_accountant::category_name(int cat)
+{
+    static const char * names[CATEGORIES_NUM] = {"headers", "bodies", "responses", "arenas"};
+
+    return (cat >= 0 && cat < CATEGORIES_NUM) ? names[cat] : "unknown";
+}
+
+const char * lizard::mem_accountant::level_name(int lv)
+{
+    static const char * names[] = {"normal", "no_bodies", "no_accept", "shed"};
+
+    return (lv >= lvNormal && lv <= lvShed) ? names[lv] : "unknown";
+}
+
+//-----------------------------------------------------------------------------------------------------------
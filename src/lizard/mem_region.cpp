@@ -0,0 +1,345 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <lizard/mem_region.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utils/error.hpp>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+// from <numaif.h>, to avoid depending on libnuma
+enum {LZ_MPOL_PREFERRED = 1};
+
+enum {DEFAULT_HUGE_PAGE_SZ = 2 * 1024 * 1024};
+static const size_t SMALL_PAGE_SZ = 4096;
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+//-----------------------------------------------------------------------------------------------------------
+
+static size_t huge_page_size()
+{
+    size_t res = DEFAULT_HUGE_PAGE_SZ;
+
+    FILE * fp = fopen("/proc/meminfo", "r");
+    if (fp)
+    {
+        char line[256];
+        unsigned long kb;
+
+        while (fgets(line, sizeof(line), fp))
+        {
+            if (1 == sscanf(line, "Hugepagesize: %lu kB", &kb))
+            {
+                res = (size_t)kb * 1024;
+                break;
+            }
+        }
+
+        fclose(fp);
+    }
+
+    return res;
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::mem_region::mem_region() : base(0), length(0), block_sz(0), blocks_num(0), next_block(0), page_sz(SMALL_PAGE_SZ), blocks_req(0), huge_req(hugeOff), mode(hugeOff), fallbacks(0)
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+lizard::mem_region::~mem_region()
+{
+    unmap();
+
+    pthread_mutex_destroy(&mutex);
+}
+
+void lizard::mem_region::unmap()
+{
+    if (base)
+    {
+        munmap(base, length);
+    }
+
+    base = 0;
+    length = 0;
+    blocks_num = 0;
+    next_block = 0;
+
+    free_blocks.clear();
+}
+
+lizard::mem_region::huge_mode lizard::mem_region::parse_mode(const std::string& str)
+{
+    if (str.empty() || str == "off")
+    {
+        return hugeOff;
+    }
+    else if (str == "transparent")
+    {
+        return hugeTransparent;
+    }
+    else if (str == "hugetlb")
+    {
+        return hugeTLB;
+    }
+
+    throw error("unknown huge page mode \"%s\"", str.c_str());
+}
+
+const char * lizard::mem_region::mode_name(int m)
+{
+    switch (m)
+    {
+    case hugeTransparent:
+        return "transparent";
+
+    case hugeTLB:
+        return "hugetlb";
+
+    default:
+        return "off";
+    }
+}
+
+bool lizard::mem_region::init(size_t block_size, size_t blocks, huge_mode huge, int node, bool prefault)
+{
+    if (base)
+    {
+        // blocks may still be out after a restart, the region stays for good
+        if (block_size != block_sz || blocks != blocks_req || (int)huge != huge_req)
+        {
+            slogger.warn("memory region of %lu byte blocks is kept, a change of its size or huge pages needs a full restart",
+                    (unsigned long)block_sz);
+        }
+
+        return true;
+    }
+
+    unmap();
+
+    block_sz = block_size;
+    blocks_req = blocks;
+    huge_req = huge;
+    mode = hugeOff;
+
+    if (hugeOff == huge || 0 == blocks || 0 == block_size)
+    {
+        return false;
+    }
+
+    const size_t huge_sz = huge_page_size();
+
+    length = (block_size * blocks + huge_sz - 1) / huge_sz * huge_sz;
+    page_sz = huge_sz;
+
+    void * m = MAP_FAILED;
+
+    if (hugeTLB == huge)
+    {
+        // reserved, so a missing huge page fails here and not with SIGBUS on first touch
+        m = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (MAP_FAILED == m)
+        {
+            slogger.warn("no hugetlbfs pages for %lu bytes (%s), using transparent huge pages",
+                    (unsigned long)length, lizard::strerror(errno));
+        }
+        else
+        {
+            mode = hugeTLB;
+        }
+    }
+
+    if (MAP_FAILED == m)
+    {
+        // one huge page more, to align the start for the huge page boundary
+        m = mmap(0, length + huge_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (MAP_FAILED == m)
+        {
+            slogger.error("can't map %lu bytes: %s", (unsigned long)length, lizard::strerror(errno));
+            length = 0;
+
+            return false;
+        }
+
+        uint8_t * start = (uint8_t *)m;
+        uint8_t * aligned = (uint8_t *)(((uintptr_t)start + huge_sz - 1) / huge_sz * huge_sz);
+
+        if (aligned > start)
+        {
+            munmap(start, aligned - start);
+        }
+
+        munmap(aligned + length, start + huge_sz - aligned);
+
+        m = aligned;
+
+        if (0 != madvise(m, length, MADV_HUGEPAGE))
+        {
+            slogger.warn("transparent huge pages are not available: %s", lizard::strerror(errno));
+        }
+
+        mode = hugeTransparent;
+    }
+
+    base = (uint8_t *)m;
+    blocks_num = length / block_size;
+    next_block = 0;
+
+    if (node >= 0)
+    {
+        unsigned long mask[4] = {0, 0, 0, 0};
+        const int bits = 8 * sizeof(unsigned long);
+
+        if (node < 4 * bits)
+        {
+            mask[node / bits] = 1UL << (node % bits);
+
+            if (0 != syscall(SYS_mbind, base, length, (int)LZ_MPOL_PREFERRED, mask, (unsigned long)(4 * bits), 0))
+            {
+                slogger.error("can't prefer NUMA node %d for a region: %s", node, lizard::strerror(errno));
+            }
+        }
+    }
+
+    if (prefault)
+    {
+        const size_t step = (hugeTLB == mode) ? huge_sz : SMALL_PAGE_SZ;
+
+        for (size_t off = 0; off < length; off += step)
+        {
+            base[off] = 0;
+        }
+    }
+
+    slogger.info("memory region: %lu blocks of %lu bytes, huge pages: %s%s", (unsigned long)blocks_num, (unsigned long)block_size,
+            mode_name(mode), prefault ? ", prefaulted" : "");
+
+    return true;
+}
+
+bool lizard::mem_region::mapped()const
+{
+    return 0 != base;
+}
+
+bool lizard::mem_region::owns(const void * ptr)const
+{
+    return base && (const uint8_t *)ptr >= base && (const uint8_t *)ptr < base + blocks_num * block_sz;
+}
+
+void * lizard::mem_region::allocate(size_t sz)
+{
+    if (sz == block_sz && base)
+    {
+        void * res = 0;
+
+        pthread_mutex_lock(&mutex);
+
+        if (!free_blocks.empty())
+        {
+            res = free_blocks.back();
+            free_blocks.pop_back();
+        }
+        else if (next_block < blocks_num)
+        {
+            res = base + block_sz * next_block++;
+        }
+        else
+        {
+            fallbacks++;
+        }
+
+        pthread_mutex_unlock(&mutex);
+
+        if (res)
+        {
+            return res;
+        }
+    }
+
+    return malloc(sz);
+}
+
+void lizard::mem_region::free(void * ptr, size_t sz)
+{
+    if (!owns(ptr))
+    {
+        ::free(ptr);
+        return;
+    }
+
+    if (hugeTransparent == mode)
+    {
+        // only whole huge pages inside the block, a smaller range would split them
+        uintptr_t from = ((uintptr_t)ptr + page_sz - 1) / page_sz * page_sz;
+        uintptr_t to = ((uintptr_t)ptr + sz) / page_sz * page_sz;
+
+        if (to > from)
+        {
+            madvise((void *)from, to - from, MADV_DONTNEED);
+        }
+    }
+
+    pthread_mutex_lock(&mutex);
+    free_blocks.push_back(ptr);
+    pthread_mutex_unlock(&mutex);
+}
+
+void lizard::mem_region::take_all(std::vector<void *>& res)
+{
+    pthread_mutex_lock(&mutex);
+
+    res.swap(free_blocks);
+    free_blocks.clear();
+
+    while (next_block < blocks_num)
+    {
+        res.push_back(base + block_sz * next_block++);
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+void lizard::mem_region::get_stats(region_stats& res)const
+{
+    pthread_mutex_lock(&mutex);
+
+    res.mode = mode;
+    res.block_size = block_sz;
+    res.blocks = blocks_num;
+    res.used = next_block - free_blocks.size();
+    res.fallbacks = fallbacks;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+//-----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,252 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/page_pool.hpp>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+lizard::page_pool mem_pages;
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::page_pool::page_pool() : huge(mem_region::hugeOff), retain_num(0), huge_req(mem_region::hugeOff), large_allocs(0)
+{
+
+}
+
+lizard::page_pool::~page_pool()
+{
+    drain();
+}
+
+size_t lizard::page_pool::class_size(int cl)
+{
+    return ((size_t)1 << (MIN_CLASS_SHIFT + cl)) + HEADER_SLACK;
+}
+
+int lizard::page_pool::class_of(size_t sz)
+{
+    for (int i = 0; i < CLASSES_NUM; i++)
+    {
+        if (sz <= class_size(i))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void lizard::page_pool::drain()
+{
+    for (int i = 0; i < CLASSES_NUM; i++)
+    {
+        if (classes[i].free_pages)
+        {
+            void * page;
+
+            while (classes[i].free_pages->pop(page))
+            {
+                if (!regions[i].owns(page))
+                {
+                    ::free(page);
+                }
+            }
+
+            delete classes[i].free_pages;
+            classes[i].free_pages = 0;
+        }
+    }
+}
+
+void lizard::page_pool::init(size_t retain, mem_region::huge_mode huge_pages, int node, bool prefault)
+{
+    for (int i = 0; i < CLASSES_NUM; i++)
+    {
+        if (regions[i].mapped())
+        {
+            // region pages live connections hold come back to these rings
+            if (retain != retain_num || (int)huge_pages != huge_req)
+            {
+                slogger.warn("page pool regions are kept, a change of <page_pool_retain> or <huge_pages> needs a full restart");
+            }
+
+            return;
+        }
+    }
+
+    drain();
+
+    retain_num = retain;
+    huge_req = huge_pages;
+
+    huge = mem_region::hugeOff;
+
+    if (retain)
+    {
+        for (int i = 0; i < CLASSES_NUM; i++)
+        {
+            std::vector<void *> pages;
+
+            if (regions[i].init(class_size(i), retain, huge_pages, node, prefault))
+            {
+                regions[i].take_all(pages);
+
+                mem_region::region_stats rs;
+                regions[i].get_stats(rs);
+                huge = rs.mode;
+            }
+
+            classes[i].free_pages = new mpmc_queue<void *>(pages.size() > retain ? pages.size() : retain);
+
+            for (size_t j = 0; j < pages.size(); j++)
+            {
+                classes[i].free_pages->push(pages[j]);
+            }
+        }
+    }
+}
+
+size_t lizard::page_pool::warm_up(size_t sz, size_t pages)
+{
+    int cl = class_of(sz);
+
+    if (-1 == cl || 0 == classes[cl].free_pages || regions[cl].mapped())
+    {
+        // region pages are in the ring since init()
+        return 0;
+    }
+
+    mpmc_queue<void *> * ring = classes[cl].free_pages;
+
+    size_t added = 0;
+
+    while (added < pages)
+    {
+        void * page = malloc(class_size(cl));
+        if (0 == page)
+        {
+            break;
+        }
+
+        memset(page, 0, class_size(cl));
+
+        if (!ring->push(page))
+        {
+            ::free(page);
+            break;
+        }
+
+        added++;
+    }
+
+    return added;
+}
+
+void * lizard::page_pool::allocate(size_t sz)
+{
+    int cl = class_of(sz);
+
+    if (-1 == cl)
+    {
+        __atomic_add_fetch(&large_allocs, 1, __ATOMIC_RELAXED);
+
+        return malloc(sz);
+    }
+
+    size_class& c = classes[cl];
+
+    void * page;
+
+    if (c.free_pages && c.free_pages->pop(page))
+    {
+        __atomic_add_fetch(&c.hits, 1, __ATOMIC_RELAXED);
+
+        return page;
+    }
+
+    __atomic_add_fetch(&c.misses, 1, __ATOMIC_RELAXED);
+
+    // always the full class size, so the page can serve any request of its class
+    return malloc(class_size(cl));
+}
+
+void lizard::page_pool::free(void * ptr, size_t sz)
+{
+    int cl = class_of(sz);
+
+    if (-1 != cl)
+    {
+        size_class& c = classes[cl];
+
+        if (regions[cl].owns(ptr))
+        {
+            // there is a slot for every region page
+            c.free_pages->push(ptr);
+            return;
+        }
+
+        if (!regions[cl].mapped() && c.free_pages && c.free_pages->push(ptr))
+        {
+            return;
+        }
+
+        __atomic_add_fetch(&c.drops, 1, __ATOMIC_RELAXED);
+    }
+
+    ::free(ptr);
+}
+
+uint64_t lizard::page_pool::get_allocs()const
+{
+    uint64_t res = __atomic_load_n(&large_allocs, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < CLASSES_NUM; i++)
+    {
+        res += __atomic_load_n(&classes[i].hits, __ATOMIC_RELAXED);
+        res += __atomic_load_n(&classes[i].misses, __ATOMIC_RELAXED);
+    }
+
+    return res;
+}
+
+void lizard::page_pool::get_stats(class_stats * res)const
+{
+    for (int i = 0; i < CLASSES_NUM; i++)
+    {
+        const size_class& c = classes[i];
+
+        res[i].size = class_size(i);
+        res[i].retained = c.free_pages ? c.free_pages->size() : 0;
+
+        res[i].hits = __atomic_load_n(&c.hits, __ATOMIC_RELAXED);
+        res[i].misses = __atomic_load_n(&c.misses, __ATOMIC_RELAXED);
+        res[i].drops = __atomic_load_n(&c.drops, __ATOMIC_RELAXED);
+
+        mem_region::region_stats rs;
+        regions[i].get_stats(rs);
+
+        res[i].region_pages = rs.blocks;
+    }
+}
+
+int lizard::page_pool::huge_mode()const
+{
+    return huge;
+}
+
+//-----------------------------------------------------------------------------------------------------------
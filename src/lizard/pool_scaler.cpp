@@ -0,0 +1,182 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/pool_scaler.hpp>
+#include <stdio.h>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::pool_scaler::pool_scaler() : min_threads(0), max_threads(0), wait_limit(0), idle_time(0), last_change(0),
+    pressure_ticks(0), idle_since(0), idle_min(0), ups(0), downs(0)
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+lizard::pool_scaler::~pool_scaler()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void lizard::pool_scaler::init(int min_th, int max_th, uint64_t wait_limit_us, uint64_t idle_time_us)
+{
+    min_threads = min_th;
+    max_threads = max_th;
+    wait_limit = wait_limit_us;
+    idle_time = idle_time_us;
+
+    last_change = 0;
+    pressure_ticks = 0;
+    idle_since = 0;
+    idle_min = 0;
+}
+
+bool lizard::pool_scaler::enabled()const
+{
+    return max_threads > min_threads;
+}
+
+int lizard::pool_scaler::get_min()const
+{
+    return min_threads;
+}
+
+int lizard::pool_scaler::get_max()const
+{
+    return max_threads;
+}
+
+void lizard::pool_scaler::add_event(int from, int to, const char * reason)
+{
+    event ev;
+    ev.time = time(0);
+    ev.from = from;
+    ev.to = to;
+    ev.reason = reason;
+
+    pthread_mutex_lock(&mutex);
+
+    if (to > from)
+    {
+        ups++;
+    }
+    else
+    {
+        downs++;
+    }
+
+    events.push_back(ev);
+
+    if (events.size() > EVENTS_NUM)
+    {
+        events.pop_front();
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    slogger.info("hard pool: %d -> %d threads (%s)", from, to, reason);
+}
+
+int lizard::pool_scaler::tick(uint64_t now, int threads, int idle_threads, size_t queue_len, uint64_t max_wait)
+{
+    bool pressure = (max_wait > wait_limit) || (0 == idle_threads && queue_len && queue_len >= (size_t)threads);
+
+    pressure_ticks = pressure ? pressure_ticks + 1 : 0;
+
+    if (pressure || 0 == idle_threads)
+    {
+        idle_since = 0;
+    }
+    else if (0 == idle_since)
+    {
+        idle_since = now;
+        idle_min = idle_threads;
+    }
+    else if (idle_threads < idle_min)
+    {
+        idle_min = idle_threads;
+    }
+
+    if (now - last_change < COOLDOWN_US)
+    {
+        return 0;
+    }
+
+    char reason[128];
+
+    if (pressure_ticks >= UP_TICKS && threads < max_threads)
+    {
+        int to = threads + (threads > 1 ? threads / 2 : 1);
+        if (to > max_threads)
+        {
+            to = max_threads;
+        }
+
+        snprintf(reason, sizeof(reason), "queue %d, max wait %.1f ms, idle %d", (int)queue_len, max_wait / 1000.0, idle_threads);
+        add_event(threads, to, reason);
+
+        last_change = now;
+        pressure_ticks = 0;
+
+        return to - threads;
+    }
+
+    if (idle_since && now - idle_since >= idle_time && threads > min_threads)
+    {
+        int to = threads - (idle_min > 1 ? idle_min / 2 : 1);
+        if (to < min_threads)
+        {
+            to = min_threads;
+        }
+
+        snprintf(reason, sizeof(reason), "%d idle for %d s", idle_min, (int)(idle_time / 1000000));
+        add_event(threads, to, reason);
+
+        last_change = now;
+        idle_since = 0;
+
+        return to - threads;
+    }
+
+    return 0;
+}
+
+uint64_t lizard::pool_scaler::get_ups()const
+{
+    pthread_mutex_lock(&mutex);
+    uint64_t res = ups;
+    pthread_mutex_unlock(&mutex);
+
+    return res;
+}
+
+uint64_t lizard::pool_scaler::get_downs()const
+{
+    pthread_mutex_lock(&mutex);
+    uint64_t res = downs;
+    pthread_mutex_unlock(&mutex);
+
+    return res;
+}
+
+void lizard::pool_scaler::get_events(std::vector<event>& res)const
+{
+    pthread_mutex_lock(&mutex);
+    res.assign(events.begin(), events.end());
+    pthread_mutex_unlock(&mutex);
+}
+
+//-----------------------------------------------------------------------------------------------------------
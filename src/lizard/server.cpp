@@ -12,6 +12,7 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include <lizard/Version.h>
@@ -22,6 +23,7 @@
 #include <stdarg.h>
 #include <stdexcept>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/time.h>
@@ -34,6 +36,25 @@ static lizard::Logger& sacclogger = lizard::getLog("access");
 lizard::statistics stats;
 
 //-----------------------------------------------------------------------------------------------------------
+static std::string xml_escape(const std::string& str)
+{
+    std::string res;
+
+    for (size_t i = 0; i < str.size(); i++)
+    {
+        switch (str[i])
+        {
+        case '<':  res += "&lt;";   break;
+        case '>':  res += "&gt;";   break;
+        case '&':  res += "&amp;";  break;
+        case '"':  res += "&quot;"; break;
+        default:   res += str[i];   break;
+        }
+    }
+
+    return res;
+}
+
 inline std::string events2string(int events)
 {
     std::string rep;
@@ -125,6 +146,7 @@ namespace lizard
     extern volatile sig_atomic_t    quit;
     extern volatile sig_atomic_t    hup;
     extern volatile sig_atomic_t    rotate;
+    extern volatile sig_atomic_t    reload_acl;
 
     extern int             MSG_LIZARD_ID;
 
@@ -182,25 +204,62 @@ void lizard::server::lz_callback::vlog_message(plugin_log_levels log_level, cons
     slogger.log(rdev2lizard_lv[log_level], fmt, ap);
 }
 
+bool lizard::server::lz_callback::complete_task(lizard::task * tsk, int result)
+{
+    return lz->complete_task(static_cast<http *>(tsk), result);
+}
+
+bool lizard::server::lz_callback::watch_fd(int fd, uint32_t events, void (*cb)(void * arg, uint32_t events), void * arg)
+{
+    return lz->watch_fd(fd, events, cb, arg);
+}
+
+uint64_t lizard::server::lz_callback::schedule_after(uint32_t ms, void (*cb)(void * arg), void * arg)
+{
+    return lz->timers.schedule_after(ms, cb, arg);
+}
+
+uint64_t lizard::server::lz_callback::schedule_every(uint32_t ms, void (*cb)(void * arg), void * arg)
+{
+    return lz->timers.schedule_every(ms, cb, arg);
+}
+
+bool lizard::server::lz_callback::cancel_timer(uint64_t id)
+{
+    return lz->timers.cancel(id);
+}
+
 //-----------------------------------------------------------------------------------------------------------
 
 lizard::server::server()
-:   incoming_sock(-1)
+:   acl_active(0)
+,   acl_pending(0)
+,   incoming_sock(-1)
 ,   stats_sock(-1)
 ,   epoll_sock(-1)
-,   epoll_wakeup_isock(-1)
-,   epoll_wakeup_osock(-1)
+,   epoll_wakeup_fd(-1)
+,   epoll_sleeping(0)
 ,   threads_num(0)
+,   easy_th_ids(0)
+,   hard_th_ids(0)
+,   hard_th_num(0)
+,   hard_th_idle(0)
+,   hard_th_retiring(0)
+,   hard_max_wait(0)
+,   hard_scale_time(0)
+,   hard_seq_ids(0)
+,   hard_timeouts_total(0)
+,   accept_paused(false)
 ,   start_time(0)
 {
-    pthread_mutex_init(&done_mutex, 0);
+    pthread_mutex_init(&acl_mutex, 0);
+
+    pthread_mutex_init(&hard_pool_mutex, 0);
+
+    pthread_mutex_init(&hard_timeout_mutex, 0);
 
-    pthread_mutex_init(&easy_proc_mutex, 0);
-    pthread_mutex_init(&hard_proc_mutex, 0);
     pthread_mutex_init(&stats_proc_mutex, 0);
 
-    pthread_cond_init(&easy_proc_cond, 0);
-    pthread_cond_init(&hard_proc_cond, 0);
     pthread_cond_init(&stats_proc_cond, 0);
 
     start_time = time(0);
@@ -218,14 +277,14 @@ lizard::server::~server()
     fire_all_threads();
 
     pthread_cond_destroy(&stats_proc_cond);
-    pthread_cond_destroy(&hard_proc_cond);
-    pthread_cond_destroy(&easy_proc_cond);
 
     pthread_mutex_destroy(&stats_proc_mutex);
-    pthread_mutex_destroy(&hard_proc_mutex);
-    pthread_mutex_destroy(&easy_proc_mutex);
 
-    pthread_mutex_destroy(&done_mutex);
+    pthread_mutex_destroy(&acl_mutex);
+
+    pthread_mutex_destroy(&hard_pool_mutex);
+
+    pthread_mutex_destroy(&hard_timeout_mutex);
 
     slogger.debug("/~server()");
 }
@@ -263,11 +322,17 @@ void lizard::server::init_threads()
     {
         throw std::logic_error("error creating stats thread");
     }
+
+    timers.start(config.root.plugin.timer_threads, &placement);
     slogger.info("%d internal threads created", threads_num);
 
     slogger.info("requested worker threads {easy: %d, hard: %d}", config.root.plugin.easy_threads, config.root.plugin.hard_threads);
 
-    for (int i = 0; i < config.root.plugin.easy_threads; i++)
+    easy_th_ids = 0;
+    hard_th_ids = 0;
+
+    // easy handlers run on the epoll thread in inline mode
+    for (int i = 0; i < config.root.plugin.easy_threads && !config.root.plugin.inline_easy; i++)
     {
         pthread_t th;
         int r = pthread_create(&th, NULL, &easy_loop_function, this);
@@ -286,26 +351,143 @@ void lizard::server::init_threads()
         }
     }
 
-    for (int i = 0; i < config.root.plugin.hard_threads; i++)
+    pthread_mutex_lock(&hard_pool_mutex);
+
+    try
     {
-        pthread_t th;
-        int r = pthread_create(&th, NULL, &hard_loop_function, this);
-        if (0 == r)
+        for (int i = 0; i < config.root.plugin.hard_threads; i++)
         {
-            slogger.debug("hard thread created");
-            hard_th.push_back(th);
+            start_hard_thread();
+        }
+    }
+    catch (...)
+    {
+        pthread_mutex_unlock(&hard_pool_mutex);
+        throw;
+    }
 
-            threads_num++;
+    // the epoll thread starts scaling the pool from here on
+    if (config.root.plugin.hard_threads_max)
+    {
+        int min_th = config.root.plugin.hard_threads_min ? config.root.plugin.hard_threads_min : config.root.plugin.hard_threads;
+
+        hard_scaler.init(min_th, config.root.plugin.hard_threads_max,
+                config.root.plugin.hard_scale_wait * 1000LLU, config.root.plugin.hard_scale_idle * 1000000LLU);
+
+        slogger.info("hard pool autoscaling {min: %d, max: %d, wait: %d ms, idle: %d s}", min_th,
+                config.root.plugin.hard_threads_max, config.root.plugin.hard_scale_wait, config.root.plugin.hard_scale_idle);
+    }
+
+    pthread_mutex_unlock(&hard_pool_mutex);
+
+    slogger.info("all worker threads created");
+}
+
+// hard_pool_mutex must be held
+void lizard::server::start_hard_thread()
+{
+    pthread_t th;
+    int r = pthread_create(&th, NULL, &hard_loop_function, this);
+    if (0 == r)
+    {
+        slogger.debug("hard thread created");
+        hard_th.push_back(th);
+
+        __atomic_add_fetch(&hard_th_num, 1, __ATOMIC_RELAXED);
+
+        threads_num++;
+    }
+    else
+    {
+        char s[256];
+        snprintf(s, 256, "error creating hard thread #%d : %s", (int)hard_th.size(), strerror(r));
+        throw std::logic_error(s);
+    }
+}
+
+void lizard::server::scale_hard_pool()
+{
+    uint64_t now = lz_utils::fine_clock();
+
+    if (now - hard_scale_time < pool_scaler::TICK_US)
+    {
+        return;
+    }
+
+    hard_scale_time = now;
+
+    pthread_mutex_lock(&hard_pool_mutex);
+
+    if (!hard_scaler.enabled())
+    {
+        pthread_mutex_unlock(&hard_pool_mutex);
+        return;
+    }
+
+    for (size_t i = 0; i < hard_retired.size(); i++)
+    {
+        pthread_join(hard_retired[i], 0);
+        threads_num--;
+
+        for (size_t j = 0; j < hard_th.size(); j++)
+        {
+            if (pthread_equal(hard_th[j], hard_retired[i]))
+            {
+                hard_th.erase(hard_th.begin() + j);
+                break;
+            }
         }
-        else
+    }
+
+    hard_retired.clear();
+
+    int threads = __atomic_load_n(&hard_th_num, __ATOMIC_RELAXED) - __atomic_load_n(&hard_th_retiring, __ATOMIC_RELAXED);
+    int idle = __atomic_load_n(&hard_th_idle, __ATOMIC_RELAXED);
+    uint64_t max_wait = __atomic_exchange_n(&hard_max_wait, 0, __ATOMIC_RELAXED);
+
+    int delta = hard_scaler.tick(now, threads, idle, hard_queue.size(), max_wait);
+
+    try
+    {
+        for (int i = 0; i < delta; i++)
         {
-            char s[256];
-            snprintf(s, 256, "error creating hard thread #%d : %s", i, strerror(r));
-            throw std::logic_error(s);
+            start_hard_thread();
         }
     }
+    catch (const std::exception &e)
+    {
+        slogger.error("hard pool: %s", e.what());
+    }
 
-    slogger.info("all worker threads created");
+    if (delta < 0)
+    {
+        __atomic_add_fetch(&hard_th_retiring, -delta, __ATOMIC_RELAXED);
+
+        hard_queue.fire_all();
+    }
+
+    pthread_mutex_unlock(&hard_pool_mutex);
+}
+
+bool lizard::server::hard_thread_retires()
+{
+    int r = __atomic_load_n(&hard_th_retiring, __ATOMIC_RELAXED);
+
+    while (r > 0)
+    {
+        if (__atomic_compare_exchange_n(&hard_th_retiring, &r, r - 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            __atomic_sub_fetch(&hard_th_num, 1, __ATOMIC_RELAXED);
+
+            pthread_mutex_lock(&hard_pool_mutex);
+            hard_retired.push_back(pthread_self());
+            pthread_mutex_unlock(&hard_pool_mutex);
+
+            return true;
+        }
+    }
+
+    return false;
 }
 
 void lizard::server::join_threads()
@@ -324,6 +506,9 @@ void lizard::server::join_threads()
     pthread_join(stats_th,  0);
     threads_num--;
 
+    // timers call into the plugin, which is unloaded after this
+    timers.stop();
+
     for (size_t i = 0; i < easy_th.size(); i++)
     {
         slogger.debug("pthread_join(easy_th[%d], 0)", (int)i);
@@ -341,19 +526,16 @@ void lizard::server::join_threads()
     }
 
     hard_th.clear();
+    hard_retired.clear();
 
     slogger.debug("%d threads left", (int)threads_num);
 }
 
 void lizard::server::fire_all_threads()
 {
-    pthread_mutex_lock(&easy_proc_mutex);
-    pthread_cond_broadcast(&easy_proc_cond);
-    pthread_mutex_unlock(&easy_proc_mutex);
-
-    pthread_mutex_lock(&hard_proc_mutex);
-    pthread_cond_broadcast(&hard_proc_cond);
-    pthread_mutex_unlock(&hard_proc_mutex);
+    easy_queue.fire_all();
+    easy_stealing_queue.fire_all();
+    hard_queue.fire_all();
 
     slogger.debug("fire_all_threads");
 }
@@ -361,190 +543,248 @@ void lizard::server::fire_all_threads()
 void lizard::server::epoll_send_wakeup()
 {
     slogger.debug("epoll_send_wakeup()");
-    char b[1] = {'w'};
+    uint64_t v = 1;
 
     int ret;
     do
     {
-        ret = write(epoll_wakeup_osock, b, 1);
-        if (ret < 0 && errno != EINTR)
+        ret = write(epoll_wakeup_fd, &v, sizeof(v));
+        if (ret < 0 && errno != EINTR && errno != EAGAIN)
         {
             slogger.error("epoll_send_wakeup(): write failure: '%s'", strerror(errno));
         }
     }
-    while (ret < 0);
+    while (ret < 0 && errno == EINTR);
 }
 
 void lizard::server::epoll_recv_wakeup()
 {
     slogger.debug("epoll_recv_wakeup()");
-    char b[1024];
+    uint64_t v;
 
     int ret;
     do
     {
-        ret = read(epoll_wakeup_isock, b, 1024);
+        ret = read(epoll_wakeup_fd, &v, sizeof(v));
         if (ret < 0 && errno != EAGAIN && errno != EINTR)
         {
             slogger.error("epoll_recv_wakeup(): read failure: '%s'", strerror(errno));
         }
     }
-    while (ret == 1024 || errno == EINTR);
+    while (ret < 0 && errno == EINTR);
 }
 
-bool lizard::server::push_easy(http * el)
+void lizard::server::init_queues()
 {
-    bool res = false;
+    task_queue<http*>::queue_type qt = config.root.plugin.lockfree_queues ? task_queue<http*>::qLockFree : task_queue<http*>::qLocked;
 
-    pthread_mutex_lock(&easy_proc_mutex);
+    easy_queue.init(qt, config.root.plugin.easy_queue_limit);
 
-    size_t eq_sz = easy_queue.size();
-    stats.report_easy_queue_len(eq_sz);
+    if (config.root.plugin.work_stealing)
+    {
+        easy_stealing_queue.init(config.root.plugin.easy_threads, config.root.plugin.easy_queue_limit);
+
+        slogger.info("easy queue: work stealing between %d workers", config.root.plugin.easy_threads);
+    }
+    hard_queue.init(qt, config.root.plugin.hard_queue_limit);
+
+    slogger.info("%s queues are used", task_queue<http*>::qLockFree == qt ? "lock-free" : "locked");
+}
+
+void lizard::server::init_placement()
+{
+    const lz_config::ROOT::AFFINITY& aff = config.root.affinity;
 
-    if (config.root.plugin.easy_queue_limit == 0 || (eq_sz < (size_t)config.root.plugin.easy_queue_limit))
+    placement.init(aff.epoll_cpus, aff.easy_cpus, aff.hard_cpus, aff.service_cpus, aff.numa_nodes);
+
+    if (!placement.empty())
     {
-        easy_queue.push_back(el);
-        res = true;
+        slogger.info("thread placement {epoll: '%s', easy: '%s', hard: '%s', service: '%s', numa nodes: '%s'}",
+                aff.epoll_cpus.c_str(), aff.easy_cpus.c_str(), aff.hard_cpus.c_str(), aff.service_cpus.c_str(),
+                aff.numa_nodes.c_str());
+    }
+}
 
-        slogger.debug("push_easy %d", el->get_fd());
+void lizard::server::warm_up()
+{
+    const lz_config::ROOT::MEMORY& mem = config.root.memory;
+
+    uint64_t start = lz_utils::fine_clock();
+
+    size_t conn_pages = 0;
+    size_t buf_pages = 0;
 
-        pthread_cond_signal(&easy_proc_cond);
+    if (mem.warmup_connections)
+    {
+        conn_pages = fds.reserve(mem.warmup_connections);
     }
 
-    pthread_mutex_unlock(&easy_proc_mutex);
+    if (mem.warmup_pages)
+    {
+        // a page of every buffer of a connection; buffers of one size class share its ring
+        const int sizes[] = {mem.read_headers_page, mem.write_title_page, mem.write_headers_page, mem.write_body_page};
 
-    return res;
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        {
+            buf_pages += mem_pages.warm_up(mem_chunk::page_alloc_size(sizes[i]), mem.warmup_pages);
+        }
+    }
+
+    factory.get_plugin()->warmup();
+
+    slogger.info("warm-up: %d connections (%d new pool pages), %d buffer pages, %.1f ms",
+            mem.warmup_connections, (int)conn_pages, (int)buf_pages, (lz_utils::fine_clock() - start) / 1000.0);
 }
 
-bool lizard::server::pop_easy_or_wait(http** el)
+bool lizard::server::push_easy(http * el)
 {
-    bool ret = false;
-
-    pthread_mutex_lock(&easy_proc_mutex);
+    size_t eq_sz = 0;
 
-    size_t eq_sz = easy_queue.size();
+    bool res = config.root.plugin.work_stealing ? easy_stealing_queue.push(el, &eq_sz) : easy_queue.push(el, &eq_sz);
 
     stats.report_easy_queue_len(eq_sz);
 
-    if (eq_sz)
+    if (res)
     {
-        *el = easy_queue.front();
+        slogger.debug("push_easy %d", el->get_fd());
+    }
 
-        slogger.debug("pop_easy %d", (*el)->get_fd());
+    return res;
+}
+
+bool lizard::server::pop_easy_or_wait(size_t id, http** el)
+{
+    size_t eq_sz = 0;
+
+    bool ret = config.root.plugin.work_stealing ? easy_stealing_queue.pop_or_wait(id, el, &eq_sz) : easy_queue.pop_or_wait(el, &eq_sz);
 
-        easy_queue.pop_front();
+    stats.report_easy_queue_len(eq_sz);
 
-        ret = true;
+    if (ret)
+    {
+        slogger.debug("pop_easy %d", (*el)->get_fd());
     }
     else
     {
         slogger.debug("pop_easy : events empty");
-
-        pthread_cond_wait(&easy_proc_cond, &easy_proc_mutex);
     }
 
-    pthread_mutex_unlock(&easy_proc_mutex);
-
     return ret;
 }
 
 bool lizard::server::push_hard(http * el)
 {
-    bool res = false;
-
-    pthread_mutex_lock(&hard_proc_mutex);
+    size_t hq_sz = 0;
 
-    size_t hq_sz = hard_queue.size();
+    uint64_t now = lz_utils::fine_clock();
 
-    stats.report_hard_queue_len(hq_sz);
+    el->set_queued_time(now);
 
-    if (config.root.plugin.hard_queue_limit == 0 || (hq_sz < (size_t)config.root.plugin.hard_queue_limit))
+    if (config.root.plugin.hard_timeout)
     {
-        hard_queue.push_back(el);
+        // the sequence is set before the task leaves this thread
+        hard_deadline d;
+        d.when = now + config.root.plugin.hard_timeout * 1000LLU;
+        d.task = el;
 
-        res = true;
+        const char * path = el->get_request_uri_path();
+        d.route = path ? path : "";
 
-        slogger.debug("push_hard %d", el->get_fd());
+        pthread_mutex_lock(&hard_timeout_mutex);
+
+        // completed by a plugin with rHard again: the former deadline goes
+        if (el->get_hard_seq())
+        {
+            hard_deadlines_dropped.push_back(el->get_hard_seq());
+        }
+
+        d.seq = ++hard_seq_ids;
+        hard_deadlines_new.push_back(d);
 
-        pthread_cond_signal(&hard_proc_cond);
+        pthread_mutex_unlock(&hard_timeout_mutex);
+
+        el->set_hard_seq(d.seq);
     }
 
-    pthread_mutex_unlock(&hard_proc_mutex);
+    bool res = hard_queue.push(el, &hq_sz);
+
+    if (!res && el->get_hard_seq())
+    {
+        pthread_mutex_lock(&hard_timeout_mutex);
+        hard_deadlines_dropped.push_back(el->get_hard_seq());
+        pthread_mutex_unlock(&hard_timeout_mutex);
+
+        el->set_hard_seq(0);
+    }
+
+    stats.report_hard_queue_len(hq_sz);
+
+    if (res)
+    {
+        slogger.debug("push_hard %d", el->get_fd());
+    }
 
     return res;
 }
 
 bool lizard::server::pop_hard_or_wait(http** el)
 {
-    bool ret = false;
+    size_t hq_sz = 0;
+
+    __atomic_add_fetch(&hard_th_idle, 1, __ATOMIC_RELAXED);
 
-    pthread_mutex_lock(&hard_proc_mutex);
+    bool ret = hard_queue.pop_or_wait(el, &hq_sz);
 
-    size_t hq_sz = hard_queue.size();
+    __atomic_sub_fetch(&hard_th_idle, 1, __ATOMIC_RELAXED);
 
     stats.report_hard_queue_len(hq_sz);
 
-    if (hq_sz)
+    if (ret)
     {
-        *el = hard_queue.front();
-
-        slogger.debug("pop_hard %d", (*el)->get_fd());
+        uint64_t now = lz_utils::fine_clock();
+        uint64_t wait = now > (*el)->get_queued_time() ? now - (*el)->get_queued_time() : 0;
+        uint64_t max_wait = __atomic_load_n(&hard_max_wait, __ATOMIC_RELAXED);
 
-        hard_queue.pop_front();
+        while (wait > max_wait && !__atomic_compare_exchange_n(&hard_max_wait, &max_wait, wait, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
-        ret = true;
+        slogger.debug("pop_hard %d", (*el)->get_fd());
     }
     else
     {
         slogger.debug("pop_hard : events empty");
-
-        pthread_cond_wait(&hard_proc_cond, &hard_proc_mutex);
     }
 
-    pthread_mutex_unlock(&hard_proc_mutex);
-
     return ret;
 }
+
 bool lizard::server::push_done(http * el)
 {
-    pthread_mutex_lock(&done_mutex);
-
-    done_queue.push_back(el);
-
-    stats.report_done_queue_len(done_queue.size());
-
     slogger.debug("push_done %d", el->get_fd());
 
-    pthread_mutex_unlock(&done_mutex);
-
-    epoll_send_wakeup();
+    // only the task that makes the list non-empty may need to wake the epoll
+    // thread, and only if it sleeps: it sets epoll_sleeping before checking
+    // the list, we check epoll_sleeping after pushing, so one of us sees the other
+    if (done_list.push(el) && __atomic_exchange_n(&epoll_sleeping, 0, __ATOMIC_SEQ_CST))
+    {
+        epoll_send_wakeup();
+    }
 
     return true;
 }
 
-bool lizard::server::pop_done(http** el)
+lizard::http * lizard::server::pop_done_all()
 {
-    bool ret = false;
+    size_t dq_sz = 0;
 
-    pthread_mutex_lock(&done_mutex);
-
-        size_t dq_sz = done_queue.size();
+    http * ret = done_list.pop_all(&dq_sz);
 
     stats.report_done_queue_len(dq_sz);
 
-    if (dq_sz)
+    if (ret)
     {
-        *el = done_queue.front();
-
-        slogger.debug("pop_done %d", (*el)->get_fd());
-
-        done_queue.pop_front();
-
-        ret = true;
+        slogger.debug("pop_done: %d tasks", (int)dq_sz);
     }
 
-    pthread_mutex_unlock(&done_mutex);
-
     return ret;
 }
 
@@ -579,8 +819,52 @@ void lizard::server::prepare()
 
     factory.load_module(config.root.plugin, config_path, &srv_callback);
 
+    init_queues();
+
+    init_placement();
+
+    // worker threads are not running yet; connections are made by the epoll
+    // thread, buffers mostly by it too
+    const lz_config::ROOT::MEMORY& mem = config.root.memory;
+
+    mem_region::huge_mode huge = mem_region::parse_mode(mem.huge_pages);
+    int node = placement.node_of_kind(thread_placement::thEpoll);
+
+    // both keep their regions over a restart, connections survive it with their pages
+    mem_pages.init(mem.page_pool_retain, huge, node, mem.prefault);
+
+    size_t conn_pages = (mem.connection_region + fd_map::OBJECTS_PER_PAGE - 1) / fd_map::OBJECTS_PER_PAGE;
+
+    if (conn_region.init(fd_map::pool_page_size(), conn_pages, huge, node, mem.prefault))
+    {
+        fds.set_page_source(&conn_region);
+    }
+
+    fds.set_pool_idle_time(mem.pool_idle_release);
+
+    http::set_page_sizes(config.root.memory.read_headers_page, config.root.memory.write_title_page,
+            config.root.memory.write_headers_page, config.root.memory.write_body_page);
+
+    http::set_post_limits(config.root.memory.post_memory_max, config.root.memory.post_max, config.root.memory.post_spill_dir);
+
+    mem_account.init((size_t)mem.memory_budget * 1024 * 1024);
+
     epoll_sock = init_epoll();
 
+    //----------------------------
+    //load access list
+
+    if (!config.root.acl_file_name.empty())
+    {
+        acl_active = new acl;
+        acl_active->load_from_file(config.root.acl_file_name.c_str());
+    }
+
+    //----------------------------
+    //warm up pools and the plugin before the first connection
+
+    warm_up();
+
     //----------------------------
     //add incoming sock
 
@@ -593,6 +877,12 @@ void lizard::server::prepare()
     lz_utils::set_nonblocking(incoming_sock);
     add_epoll_action(incoming_sock, EPOLL_CTL_ADD, EPOLLIN);
 
+    // still over the budget after a restart: the listener waits again
+    if (mem_account.get_budget() && mem_account.get_level() >= mem_accountant::lvNoAccept)
+    {
+        check_memory_budget();
+    }
+
     //----------------------------
     //add stats sock
 
@@ -607,22 +897,22 @@ void lizard::server::prepare()
     //----------------------------
     //add epoll wakeup fd
 
-    int pipefd[2];
-    if (::pipe(pipefd) == -1)
+    epoll_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (-1 == epoll_wakeup_fd)
     {
-        throw std::logic_error((std::string)"server::prepare():pipe() failed : " + strerror(errno));
+        throw std::logic_error((std::string)"server::prepare():eventfd() failed : " + strerror(errno));
     }
 
-    epoll_wakeup_osock = pipefd[1];
-    epoll_wakeup_isock = pipefd[0];
-
-    lz_utils::set_nonblocking(epoll_wakeup_isock);
-    add_epoll_action(epoll_wakeup_isock, EPOLL_CTL_ADD, EPOLLIN | EPOLLET);
+    add_epoll_action(epoll_wakeup_fd, EPOLL_CTL_ADD, EPOLLIN | EPOLLET);
 
 }
 
 void lizard::server::finalize()
 {
+    // the listener and epoll are made anew by prepare()
+    accept_paused = false;
+    paused_bodies.clear();
+
     if (-1 != incoming_sock)
     {
         lz_utils::close_connection(incoming_sock);
@@ -635,16 +925,10 @@ void lizard::server::finalize()
         stats_sock = -1;
     }
 
-    if (-1 != epoll_wakeup_isock)
-    {
-        close(epoll_wakeup_isock);
-        epoll_wakeup_isock = -1;
-    }
-
-    if (-1 != epoll_wakeup_osock)
+    if (-1 != epoll_wakeup_fd)
     {
-        close(epoll_wakeup_osock);
-        epoll_wakeup_osock = -1;
+        close(epoll_wakeup_fd);
+        epoll_wakeup_fd = -1;
     }
 
     if (-1 != epoll_sock)
@@ -653,11 +937,74 @@ void lizard::server::finalize()
         epoll_sock = -1;
     }
 
+    pthread_mutex_lock(&acl_mutex);
+
+    delete acl_active;
+    acl_active = 0;
+
+    delete acl_pending;
+    __atomic_store_n(&acl_pending, (acl *)0, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&acl_mutex);
+
     factory.unload_module();
 }
 
 //-----------------------------------------------------------------------------------------------------------
 
+void lizard::server::load_acl()
+{
+    reload_acl = 0;
+
+    if (config.root.acl_file_name.empty())
+    {
+        slogger.warn("acl reload requested, but <acl_file_name> is not set in config");
+        return;
+    }
+
+    acl * new_acl = new acl;
+
+    try
+    {
+        new_acl->load_from_file(config.root.acl_file_name.c_str());
+    }
+    catch (const std::exception &e)
+    {
+        slogger.error("acl reload failed, keeping current rules: %s", e.what());
+
+        delete new_acl;
+        return;
+    }
+
+    pthread_mutex_lock(&acl_mutex);
+
+    delete acl_pending;
+    __atomic_store_n(&acl_pending, new_acl, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&acl_mutex);
+}
+
+void lizard::server::apply_acl()
+{
+    pthread_mutex_lock(&acl_mutex);
+
+    if (0 == acl_pending)
+    {
+        pthread_mutex_unlock(&acl_mutex);
+        return;
+    }
+
+    delete acl_active;
+    acl_active = acl_pending;
+    __atomic_store_n(&acl_pending, (acl *)0, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&acl_mutex);
+
+    slogger.notice("acl reloaded: %d rules", (int)acl_active->rules_num());
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
 int lizard::server::init_epoll()
 {
     slogger.debug("init_epoll");
@@ -715,9 +1062,27 @@ void lizard::server::add_epoll_action(int fd, int action, uint32_t mask)
 
 void lizard::server::epoll_processing_loop()
 {
-    http * done_task = 0;
-    while (pop_done(&done_task))
+    // a hint only, apply_acl() takes the rules under acl_mutex
+    if (__atomic_load_n(&acl_pending, __ATOMIC_ACQUIRE))
+    {
+        apply_acl();
+    }
+
+    if (config.root.plugin.hard_threads_max)
+    {
+        scale_hard_pool();
+    }
+
+    http * done_task = pop_done_all();
+    while (done_task)
     {
+        http * next_task = mpsc_list<http>::next(done_task);
+
+        if (done_task->get_hard_seq())
+        {
+            forget_hard_deadline(done_task->get_hard_seq());
+            done_task->set_hard_seq(0);
+        }
         done_task->unlock();
 
         if (-1 != done_task->get_fd())
@@ -730,15 +1095,28 @@ void lizard::server::epoll_processing_loop()
             slogger.debug("%d is already dead while travelling through queues", done_task->get_fd());
             fds.release(done_task);
         }
+
+        done_task = next_task;
+    }
+
+    int timeout = fds.min_timeout()/*EPOLL_TIMEOUT*/;
+
+    __atomic_store_n(&epoll_sleeping, 1, __ATOMIC_SEQ_CST);
+
+    if (!done_list.empty())
+    {
+        timeout = 0;
     }
 
     int nfds = 0;
     do
     {
-        nfds = epoll_wait(epoll_sock, events, EPOLL_EVENTS, fds.min_timeout()/*EPOLL_TIMEOUT*/);
+        nfds = epoll_wait(epoll_sock, events, EPOLL_EVENTS, timeout);
     }
     while (nfds == -1 && (errno == EINTR || errno == EAGAIN));
 
+    __atomic_store_n(&epoll_sleeping, 0, __ATOMIC_RELAXED);
+
     if (-1 == nfds)
     {
         throw std::logic_error((std::string)"epoll_wait : " + strerror(errno));
@@ -760,17 +1138,28 @@ void lizard::server::epoll_processing_loop()
 
     for (int i = 0; i < nfds; i++)
     {
-        if (events[i].data.fd == epoll_wakeup_isock)
+        if (events[i].data.u64 & WATCH_TAG)
+        {
+            process_watch(events[i]);
+        }
+        else if (events[i].data.fd == epoll_wakeup_fd)
         {
             epoll_recv_wakeup();
         }
         else if (events[i].data.fd == incoming_sock)
         {
             struct in_addr ip;
+            struct sockaddr_storage peer;
 
-            int client = lz_utils::accept_new_connection(incoming_sock, ip);
+            int client = lz_utils::accept_new_connection(incoming_sock, ip, &peer);
 
-            if (client >= 0)
+            if (client >= 0 && acl_active && !acl_active->allowed((struct sockaddr *)&peer))
+            {
+                slogger.debug("accept_new_connection: %d from %s rejected by acl", client, inet_ntoa(ip));
+
+                lz_utils::close_connection(client);
+            }
+            else if (client >= 0)
             {
                 slogger.debug("accept_new_connection: %d from %s", client, inet_ntoa(ip));
 
@@ -792,6 +1181,16 @@ void lizard::server::epoll_processing_loop()
         }
     }
 
+    if (config.root.plugin.hard_timeout)
+    {
+        check_hard_timeouts();
+    }
+
+    if (mem_account.get_budget())
+    {
+        check_memory_budget();
+    }
+
     fds.kill_oldest(1000 * config.root.plugin.connection_timeout);
 
     stats.process();
@@ -803,6 +1202,164 @@ void lizard::server::epoll_processing_loop()
     }
 }
 
+void lizard::server::merge_hard_deadlines()
+{
+    pthread_mutex_lock(&hard_timeout_mutex);
+
+    for (size_t i = 0; i < hard_deadlines_new.size(); i++)
+    {
+        hard_deadlines.push_back(hard_deadlines_new[i]);
+        std::push_heap(hard_deadlines.begin(), hard_deadlines.end(), later_deadline());
+
+        hard_pending[hard_deadlines_new[i].seq] = hard_deadlines_new[i].task;
+    }
+
+    hard_deadlines_new.clear();
+
+    for (size_t i = 0; i < hard_deadlines_dropped.size(); i++)
+    {
+        hard_pending.erase(hard_deadlines_dropped[i]);
+    }
+
+    hard_deadlines_dropped.clear();
+
+    pthread_mutex_unlock(&hard_timeout_mutex);
+}
+
+// the task is back: its deadline must not touch it any more, the pool may
+// free its page
+void lizard::server::forget_hard_deadline(uint64_t seq)
+{
+    if (!hard_pending.erase(seq))
+    {
+        // it came back before its deadline was merged
+        merge_hard_deadlines();
+        hard_pending.erase(seq);
+    }
+}
+
+void lizard::server::check_hard_timeouts()
+{
+    merge_hard_deadlines();
+
+    uint64_t now = lz_utils::fine_clock();
+
+    while (!hard_deadlines.empty() && hard_deadlines.front().when <= now)
+    {
+        hard_deadline d = hard_deadlines.front();
+
+        std::pop_heap(hard_deadlines.begin(), hard_deadlines.end(), later_deadline());
+        hard_deadlines.pop_back();
+
+        // only tasks still out on hard threads are in hard_pending, the
+        // pointers of returned ones are never followed
+        std::map<uint64_t, http *>::iterator it = hard_pending.find(d.seq);
+        if (it == hard_pending.end())
+        {
+            continue;
+        }
+
+        http * task = it->second;
+        hard_pending.erase(it);
+
+        if (-1 != task->get_fd())
+        {
+            abandon_hard_task(task, d.route);
+        }
+    }
+}
+
+void lizard::server::abandon_hard_task(http * task, const std::string& route)
+{
+    static const char body[] = "hard handler timeout\n";
+
+    int fd = task->get_fd();
+
+    task->set_hard_seq(0);
+
+    // the request strings belong to the worker now
+    slogger.warn("hard handler timeout: %d from %s, %s is answered with 504",
+            fd, inet_ntoa(task->get_request_ip()), route.c_str());
+
+    pthread_mutex_lock(&hard_timeout_mutex);
+
+    hard_timeouts_total++;
+
+    std::map<std::string, uint64_t>::iterator it = hard_timeouts.find(route);
+    if (it != hard_timeouts.end())
+    {
+        it->second++;
+    }
+    else if (hard_timeouts.size() < HARD_TIMEOUT_ROUTES)
+    {
+        hard_timeouts[route] = 1;
+    }
+    else
+    {
+        hard_timeouts["other"]++;
+    }
+
+    pthread_mutex_unlock(&hard_timeout_mutex);
+
+    // the worker owns the response buffers: write a canned answer right to the
+    // socket, nothing else has been written for this request yet
+    char resp[256];
+    int len = snprintf(resp, sizeof(resp), "HTTP/%d.%d 504 Gateway Timeout\r\nContent-Type: text/plain\r\n"
+            "Content-Length: %d\r\nConnection: close\r\n\r\n%s",
+            task->get_version_major(), task->get_version_minor(), (int)(sizeof(body) - 1), body);
+
+    if (send(fd, resp, len, MSG_NOSIGNAL | MSG_DONTWAIT) != len)
+    {
+        slogger.debug("%d: 504 is not sent completely", fd);
+    }
+
+    // closes the socket only, the worker's result is dropped when it comes back
+    fds.del(fd);
+}
+
+void lizard::server::check_memory_budget()
+{
+    int level = mem_account.get_level();
+
+    if (level >= mem_accountant::lvNoAccept && !accept_paused)
+    {
+        slogger.warn("memory budget: %lu of %lu bytes used, new connections are not accepted",
+                (unsigned long)mem_account.used(), (unsigned long)mem_account.get_budget());
+
+        add_epoll_action(incoming_sock, EPOLL_CTL_DEL, 0);
+        accept_paused = true;
+
+        mem_account.report(mem_accountant::evAcceptPaused);
+    }
+    else if (level < mem_accountant::lvNoAccept && accept_paused)
+    {
+        slogger.info("memory budget: %lu of %lu bytes used, accepting connections again",
+                (unsigned long)mem_account.used(), (unsigned long)mem_account.get_budget());
+
+        add_epoll_action(incoming_sock, EPOLL_CTL_ADD, EPOLLIN);
+        accept_paused = false;
+    }
+
+    if (level < mem_accountant::lvNoBodies && !paused_bodies.empty())
+    {
+        std::set<int> resumed;
+        resumed.swap(paused_bodies);
+
+        for (std::set<int>::const_iterator it = resumed.begin(); it != resumed.end(); ++it)
+        {
+            // the connection may have timed out, or the fd went to another one
+            http * con = fds.acquire(*it);
+
+            if (con && con->post_paused() && !con->is_locked())
+            {
+                con->allow_read();
+
+                process(con);
+            }
+        }
+    }
+}
+
 bool lizard::server::process_event(const epoll_event& ev)
 {
     slogger.debug("query event: %s", events2string(ev).c_str());
@@ -852,29 +1409,60 @@ bool lizard::server::process_event(const epoll_event& ev)
 
 bool lizard::server::process(http * con)
 {
-    if (!con->is_locked())
+    while (!con->is_locked())
     {
         con->process();
 
-        if (con->state() == http::sReadyToHandle)
+        if (con->post_paused())
+        {
+            if (paused_bodies.insert(con->get_fd()).second)
+            {
+                slogger.debug("%d: request body waits for memory", con->get_fd());
+
+                mem_account.report(mem_accountant::evBodyPaused);
+            }
+        }
+        else if (con->state() == http::sReadyToHandle)
         {
             slogger.access("%s|%s?%s|", inet_ntoa(con->get_request_ip()),
                 con->get_request_uri_path(), con->get_request_uri_params());
 
-            slogger.debug("push_easy(%d)", con->get_fd());
-
             con->lock();
 
-            if (false == push_easy(con))
+            if (mem_account.get_level() >= mem_accountant::lvShed)
             {
-                slogger.debug("easy queue full: easy_queue_size == %d", config.root.plugin.easy_queue_limit);
+                slogger.debug("memory budget exceeded: %d is answered with 503", con->get_fd());
+
+                con->set_canned_reply(http::cannedMemoryBudget);
 
-                con->set_response_status(503);
-                con->set_response_header("Content-type", "text/plain");
-                con->append_response_body("easy queue filled!", strlen("easy queue filled!"));
+                mem_account.report(mem_accountant::evShed);
 
                 push_done(con);
             }
+            else if (config.root.plugin.inline_easy)
+            {
+                slogger.debug("run_easy(%d)", con->get_fd());
+
+                if (run_easy(con))
+                {
+                    // response is ready, write it right away
+                    con->unlock();
+                    continue;
+                }
+            }
+            else
+            {
+                slogger.debug("push_easy(%d)", con->get_fd());
+
+                if (false == push_easy(con))
+                {
+                    slogger.debug("easy queue full: easy_queue_size == %d", config.root.plugin.easy_queue_limit);
+
+                    con->set_canned_reply(http::cannedEasyQueue);
+
+                    push_done(con);
+                }
+            }
         }
         else if (con->state() == http::sDone || con->state() == http::sUndefined)
         {
@@ -882,79 +1470,165 @@ bool lizard::server::process(http * con)
 
             fds.del(con->get_fd());
         }
+
+        break;
     }
 
     return true;
 }
 
-void lizard::server::easy_processing_loop()
+void lizard::server::easy_processing_loop(size_t id)
 {
-    lizard::plugin * plugin = factory.get_plugin();
-
     //lizard::statistics::reporter easy_reporter(stats, lizard::statistics::reporter::repEasy);
 
     http * task = 0;
 
-    if (pop_easy_or_wait(&task))
+    if (pop_easy_or_wait(id, &task))
     {
         slogger.debug("lizard::easy_loop_function.fd = %d", task->get_fd());
 
-        switch(plugin->handle_easy(task))
+        if (run_easy(task))
         {
-        case plugin::rSuccess:
+            push_done(task);
+        }
 
-            slogger.debug("easy_loop: processed %d", task->get_fd());
+        //easy_reporter.commit();
+    }
+}
 
-            push_done(task);
+bool lizard::server::run_easy(http * task)
+{
+    return dispatch_easy_result(task, factory.get_plugin()->handle_easy(task));
+}
 
-            break;
+bool lizard::server::dispatch_easy_result(http * task, int result)
+{
+    switch(result)
+    {
+    case plugin::rSuccess:
 
-        case plugin::rHard:
+        slogger.debug("easy_loop: processed %d", task->get_fd());
 
-            slogger.debug("easy thread -> hard thread");
+        return true;
 
-            if (config.root.plugin.hard_threads)
-            {
-                bool ret = push_hard(task);
-                if (false == ret)
-                {
-                    slogger.debug("hard queue full: hard_queue_size == %d", config.root.plugin.hard_queue_limit);
+    case plugin::rHard:
 
-                    task->set_response_status(503);
-                    task->set_response_header("Content-type", "text/plain");
-                    task->append_response_body("hard queue filled!", strlen("hard queue filled!"));
+        slogger.debug("easy thread -> hard thread");
 
-                    push_done(task);
-                }
-            }
-            else
+        if (config.root.plugin.hard_threads)
+        {
+            bool ret = push_hard(task);
+            if (false == ret)
             {
-                slogger.error("easy-thread tried to enqueue hard-thread, but config::plugin::hard_threads = 0");
+                slogger.debug("hard queue full: hard_queue_size == %d", config.root.plugin.hard_queue_limit);
 
-                task->set_response_status(503);
-                task->set_response_header("Content-type", "text/plain");
-                task->append_response_body("easy loop error", strlen("easy loop error"));
+                task->set_canned_reply(http::cannedHardQueue);
 
-                push_done(task);
+                return true;
             }
+        }
+        else
+        {
+            slogger.error("easy-thread tried to enqueue hard-thread, but config::plugin::hard_threads = 0");
 
-            break;
+            task->set_canned_reply(http::cannedEasyError);
 
-        case plugin::rError:
+            return true;
+        }
 
-            slogger.error("easy thread reports error");
+        break;
 
-            task->set_response_status(503);
-            task->set_response_header("Content-type", "text/plain");
-            task->append_response_body("easy loop error", strlen("easy loop error"));
+    case plugin::rAsync:
 
-            push_done(task);
+        slogger.debug("easy_loop: %d is kept by plugin", task->get_fd());
 
-            break;
+        break;
+
+    case plugin::rError:
+    default:
+
+        slogger.error("easy thread reports error");
+
+        task->set_canned_reply(http::cannedEasyError);
+
+        return true;
+    }
+
+    return false;
+}
+
+bool lizard::server::complete_task(http * task, int result)
+{
+    switch(result)
+    {
+    case plugin::rHard:
+
+        if (0 == config.root.plugin.hard_threads || false == push_hard(task))
+        {
+            slogger.debug("complete_task: %d can't be passed to hard thread", task->get_fd());
+            return false;
         }
 
-        //easy_reporter.commit();
+        return true;
+
+    case plugin::rAsync:
+
+        slogger.error("complete_task: rAsync is not a completion, %d is answered with error", task->get_fd());
+
+        dispatch_easy_result(task, plugin::rError);
+        push_done(task);
+
+        return true;
+
+    default:
+
+        dispatch_easy_result(task, result);
+        push_done(task);
+
+        return true;
+    }
+}
+
+bool lizard::server::watch_fd(int fd, uint32_t events, void (*cb)(void * arg, uint32_t events), void * arg)
+{
+    fd_watch * w = new fd_watch;
+    w->fd = fd;
+    w->cb = cb;
+    w->arg = arg;
+
+    struct epoll_event evt;
+    memset(&evt, 0, sizeof(evt));
+
+    evt.events = events | EPOLLONESHOT;
+    evt.data.u64 = WATCH_TAG | (uint64_t)(uintptr_t)w;
+
+    int r;
+    do
+    {
+        r = epoll_ctl(epoll_sock, EPOLL_CTL_ADD, fd, &evt);
+    }
+    while (r < 0 && errno == EINTR);
+
+    if (-1 == r)
+    {
+        slogger.error("watch_fd(%d): epoll_ctl : %s", fd, strerror(errno));
+
+        delete w;
+        return false;
     }
+
+    return true;
+}
+
+void lizard::server::process_watch(const epoll_event& ev)
+{
+    fd_watch * w = (fd_watch *)(uintptr_t)(ev.data.u64 & ~WATCH_TAG);
+
+    epoll_ctl(epoll_sock, EPOLL_CTL_DEL, w->fd, 0);
+
+    w->cb(w->arg, ev.events);
+
+    delete w;
 }
 
 void lizard::server::hard_processing_loop()
@@ -980,14 +1654,19 @@ void lizard::server::hard_processing_loop()
 
             break;
 
+        case plugin::rAsync:
+
+            slogger.debug("hard_loop: %d is kept by plugin", task->get_fd());
+
+            break;
+
         case plugin::rHard:
         case plugin::rError:
+        default:
 
             slogger.error("hard_loop reports error");
 
-            task->set_response_status(503);
-            task->set_response_header("Content-type", "text/plain");
-            task->append_response_body("hard loop error", strlen("hard loop error"));
+            task->set_canned_reply(http::cannedHardError);
 
             push_done(task);
 
@@ -1008,6 +1687,11 @@ void lizard::server::idle_processing_loop()
 
         while (!quit && !hup)
         {
+            if (reload_acl)
+            {
+                load_acl();
+            }
+
             sleep(1);
         }
     }
@@ -1020,6 +1704,11 @@ void lizard::server::idle_processing_loop()
 
         while (!quit && !hup)
         {
+            if (reload_acl)
+            {
+                load_acl();
+            }
+
             factory.idle();
 
             lz_utils::uwait(secs, nsecs);
@@ -1036,6 +1725,8 @@ void *lizard::epoll_loop_function(void *ptr)
 {
     lizard::server *srv = (lizard::server *) ptr;
 
+    srv->placement.apply(thread_placement::thEpoll, 0, "lz-epoll");
+
     try
     {
         while (!quit && !hup)
@@ -1059,11 +1750,18 @@ void *lizard::easy_loop_function(void *ptr)
 {
     lizard::server *srv = (lizard::server *) ptr;
 
+    size_t id = __atomic_fetch_add(&srv->easy_th_ids, 1, __ATOMIC_RELAXED);
+
+    char name[16];
+    snprintf(name, sizeof(name), "lz-easy-%d", (int)id);
+
+    srv->placement.apply(thread_placement::thEasy, id, name);
+
     try
     {
         while (!quit && !hup)
         {
-            srv->easy_processing_loop();
+            srv->easy_processing_loop(id);
         }
     }
     catch (const std::exception &e)
@@ -1082,10 +1780,27 @@ void *lizard::hard_loop_function(void *ptr)
 {
      lizard::server *srv = (lizard::server *) ptr;
 
+    size_t id = __atomic_fetch_add(&srv->hard_th_ids, 1, __ATOMIC_RELAXED);
+
+    char name[16];
+    snprintf(name, sizeof(name), "lz-hard-%d", (int)id);
+
+    srv->placement.apply(thread_placement::thHard, id, name);
+
+    bool retired = false;
+
     try
     {
         while (!quit && !hup)
         {
+            if (srv->hard_thread_retires())
+            {
+                slogger.debug("%s retired", name);
+
+                retired = true;
+                break;
+            }
+
              srv->hard_processing_loop();
         }
     }
@@ -1095,7 +1810,11 @@ void *lizard::hard_loop_function(void *ptr)
         slogger.crit("hard_loop: exception: %s", e.what());
     }
 
-    srv->fire_all_threads();
+    if (!retired)
+    {
+        srv->fire_all_threads();
+    }
+
     pthread_exit(NULL);
 }
 
@@ -1105,6 +1824,8 @@ void *lizard::idle_loop_function(void *ptr)
 {
     lizard::server *srv = (lizard::server *) ptr;
 
+    srv->placement.apply(thread_placement::thService, 0, "lz-idle");
+
     try
     {
         while (!quit && !hup)
@@ -1129,6 +1850,8 @@ void *lizard::stats_loop_function(void *ptr)
     lizard::server *srv = (lizard::server *) ptr;
     lizard::http stats_parser;
 
+    srv->placement.apply(thread_placement::thService, 1, "lz-stats");
+
     try
     {
         while (!quit && !hup)
@@ -1183,15 +1906,18 @@ void *lizard::stats_loop_function(void *ptr)
                             snprintf(buff, 1024, "\t<rps>%.4f</rps>\n", stats.get_rps());
                             resp += buff;
 
+                            snprintf(buff, 1024, "\t<requests>%llu</requests>\n", (unsigned long long)stats.get_requests_count());
+                            resp += buff;
+
                             snprintf(buff, 1024, "\t<fd_count>%d</fd_count>\n", (int)srv->fds.fd_count());
                             resp += buff;
 
                             snprintf(buff, 1024, "\t<queues>\n\t\t<easy>%d</easy>\n\t\t<max_easy>%d</max_easy>\n"
                                 "\t\t<hard>%d</hard>\n\t\t<max_hard>%d</max_hard>\n\t\t<done>%d</done>\n"
                                 "\t\t<max_done>%d</max_done>\n\t</queues>\n",
-                                    (int)stats.easy_queue_len,
-                                                                        (int)stats.easy_queue_max_len,
-                                    (int)stats.hard_queue_len,
+                                    (int)(srv->config.root.plugin.work_stealing ? srv->easy_stealing_queue.size() : srv->easy_queue.size()),
+                                    (int)stats.easy_queue_max_len,
+                                    (int)srv->hard_queue.size(),
                                     (int)stats.hard_queue_max_len,
                                     (int)stats.done_queue_len,
                                     (int)stats.done_queue_max_len);
@@ -1201,10 +1927,202 @@ void *lizard::stats_loop_function(void *ptr)
                                     stats.get_min_lifetime(), stats.get_mid_lifetime(), stats.get_max_lifetime());
                             resp += buff;
 
-                            snprintf(buff, 1024, "\t<mem_allocator>\n\t\t<pages>%d</pages>\n\t\t<objects>%d</objects>\n\t</mem_allocator>\n",
-                                    (int)stats.pages_in_http_pool, (int)stats.objects_in_http_pool);
+                            snprintf(buff, 1024, "\t<mem_allocator>\n\t\t<pages>%d</pages>\n\t\t<objects>%d</objects>\n\t\t<depot_magazines>%d</depot_magazines>\n"
+                                "\t\t<object_size>%d</object_size>\n",
+                                    (int)stats.pages_in_http_pool, (int)stats.objects_in_http_pool, (int)srv->fds.pool_depot_magazines(),
+                                    (int)fd_map::object_size());
+                            resp += buff;
+
+                            std::vector<fd_map::elements_pool_t::cache_stats> caches;
+                            srv->fds.get_pool_stats(caches);
+
+                            for (size_t i = 0; i < caches.size(); i++)
+                            {
+                                const fd_map::elements_pool_t::cache_stats& c = caches[i];
+
+                                snprintf(buff, 1024, "\t\t<thread name=\"%s\" in_use=\"%lld\" cached=\"%d\" allocs=\"%llu\" frees=\"%llu\" depot_gets=\"%llu\" depot_puts=\"%llu\"/>\n",
+                                        c.thread.c_str(), (long long)(c.allocs - c.frees), (int)c.cached,
+                                        (unsigned long long)c.allocs, (unsigned long long)c.frees,
+                                        (unsigned long long)c.depot_gets, (unsigned long long)c.depot_puts);
+                                resp += buff;
+                            }
+
+                            fd_map::elements_pool_t::occupancy_stats occ;
+                            srv->fds.get_pool_occupancy(occ);
+
+                            snprintf(buff, 1024, "\t\t<occupancy pages=\"%u\" empty=\"%u\" full=\"%u\" used_0_25=\"%u\" used_25_50=\"%u\" used_50_75=\"%u\" "
+                                "used_75_100=\"%u\" objects=\"%u\" capacity=\"%u\" fragmentation=\"%.4f\" released_pages=\"%llu\"/>\n",
+                                    occ.pages, occ.empty_pages, occ.full_pages, occ.partial_pages[0], occ.partial_pages[1],
+                                    occ.partial_pages[2], occ.partial_pages[3], occ.objects, occ.capacity, occ.fragmentation,
+                                    (unsigned long long)occ.released_pages);
+                            resp += buff;
+
+                            mem_region::region_stats rs;
+                            srv->conn_region.get_stats(rs);
+
+                            snprintf(buff, 1024, "\t\t<region huge_pages=\"%s\" pages=\"%d\" used=\"%d\" fallbacks=\"%llu\"/>\n",
+                                    mem_region::mode_name(rs.mode), (int)rs.blocks, (int)rs.used, (unsigned long long)rs.fallbacks);
                             resp += buff;
 
+                            resp += "\t</mem_allocator>\n";
+
+                            page_pool::class_stats page_classes[page_pool::CLASSES_NUM];
+                            mem_pages.get_stats(page_classes);
+
+                            uint64_t page_allocs = mem_pages.get_allocs();
+                            uint64_t requests = stats.get_requests_count();
+
+                            snprintf(buff, 1024, "\t<page_pool>\n\t\t<allocs>%llu</allocs>\n\t\t<allocs_per_request>%.4f</allocs_per_request>\n"
+                                "\t\t<huge_pages>%s</huge_pages>\n",
+                                    (unsigned long long)page_allocs, requests ? (double)page_allocs / requests : 0.0,
+                                    mem_region::mode_name(mem_pages.huge_mode()));
+                            resp += buff;
+
+                            for (int i = 0; i < page_pool::CLASSES_NUM; i++)
+                            {
+                                const page_pool::class_stats& c = page_classes[i];
+
+                                snprintf(buff, 1024, "\t\t<class size=\"%d\" retained=\"%d\" region=\"%d\" hits=\"%llu\" misses=\"%llu\" drops=\"%llu\" hit_rate=\"%.4f\"/>\n",
+                                        (int)c.size, (int)c.retained, (int)c.region_pages, (unsigned long long)c.hits, (unsigned long long)c.misses,
+                                        (unsigned long long)c.drops, (c.hits + c.misses) ? (double)c.hits / (c.hits + c.misses) : 0.0);
+                                resp += buff;
+                            }
+
+                            resp += "\t</page_pool>\n";
+
+                            snprintf(buff, 1024, "\t<memory_budget>\n\t\t<budget>%llu</budget>\n\t\t<used>%llu</used>\n\t\t<level>%s</level>\n",
+                                    (unsigned long long)mem_account.get_budget(), (unsigned long long)mem_account.used(),
+                                    mem_accountant::level_name(mem_account.get_level()));
+                            resp += buff;
+
+                            for (int i = 0; i < mem_accountant::CATEGORIES_NUM; i++)
+                            {
+                                snprintf(buff, 1024, "\t\t<category name=\"%s\" bytes=\"%llu\" peak=\"%llu\"/>\n",
+                                        mem_accountant::category_name(i), (unsigned long long)mem_account.used(i),
+                                        (unsigned long long)mem_account.peak(i));
+                                resp += buff;
+                            }
+
+                            snprintf(buff, 1024, "\t\t<body_pauses>%llu</body_pauses>\n\t\t<accept_pauses>%llu</accept_pauses>\n"
+                                "\t\t<shed>%llu</shed>\n\t</memory_budget>\n",
+                                    (unsigned long long)mem_account.get_events(mem_accountant::evBodyPaused),
+                                    (unsigned long long)mem_account.get_events(mem_accountant::evAcceptPaused),
+                                    (unsigned long long)mem_account.get_events(mem_accountant::evShed));
+                            resp += buff;
+
+                            if (srv->config.root.plugin.hard_threads_max)
+                            {
+                                snprintf(buff, 1024, "\t<hard_pool>\n\t\t<threads>%d</threads>\n\t\t<idle>%d</idle>\n"
+                                    "\t\t<min>%d</min>\n\t\t<max>%d</max>\n\t\t<scale_ups>%llu</scale_ups>\n\t\t<scale_downs>%llu</scale_downs>\n",
+                                        __atomic_load_n(&srv->hard_th_num, __ATOMIC_RELAXED),
+                                        __atomic_load_n(&srv->hard_th_idle, __ATOMIC_RELAXED),
+                                        srv->hard_scaler.get_min(),
+                                        srv->hard_scaler.get_max(),
+                                        (unsigned long long)srv->hard_scaler.get_ups(),
+                                        (unsigned long long)srv->hard_scaler.get_downs());
+                                resp += buff;
+
+                                std::vector<pool_scaler::event> events;
+                                srv->hard_scaler.get_events(events);
+
+                                for (size_t i = 0; i < events.size(); i++)
+                                {
+                                    snprintf(buff, 1024, "\t\t<event time=\"%d\" from=\"%d\" to=\"%d\">%s</event>\n",
+                                            (int)events[i].time, events[i].from, events[i].to, events[i].reason.c_str());
+                                    resp += buff;
+                                }
+
+                                resp += "\t</hard_pool>\n";
+                            }
+
+                            timer_service::stats ts;
+                            srv->timers.get_stats(ts);
+
+                            snprintf(buff, 1024, "\t<timers>\n\t\t<scheduled>%d</scheduled>\n\t\t<runs>%llu</runs>\n\t\t<max_lag>%.4f</max_lag>\n\t</timers>\n",
+                                    (int)ts.scheduled, (unsigned long long)ts.runs, ts.max_lag / 1000.0);
+                            resp += buff;
+
+                            if (srv->config.root.plugin.hard_timeout)
+                            {
+                                pthread_mutex_lock(&srv->hard_timeout_mutex);
+
+                                snprintf(buff, 1024, "\t<hard_timeouts>\n\t\t<total>%llu</total>\n",
+                                        (unsigned long long)srv->hard_timeouts_total);
+                                resp += buff;
+
+                                for (std::map<std::string, uint64_t>::const_iterator it = srv->hard_timeouts.begin(); it != srv->hard_timeouts.end(); ++it)
+                                {
+                                    resp += "\t\t<route path=\"";
+                                    resp += xml_escape(it->first);
+
+                                    snprintf(buff, 1024, "\" count=\"%llu\"/>\n", (unsigned long long)it->second);
+                                    resp += buff;
+                                }
+
+                                pthread_mutex_unlock(&srv->hard_timeout_mutex);
+
+                                resp += "\t</hard_timeouts>\n";
+                            }
+
+                            if (srv->config.root.plugin.work_stealing)
+                            {
+                                uint64_t pops_total = 0;
+                                uint64_t steals_total = 0;
+
+                                resp += "\t<easy_workers>\n";
+
+                                for (size_t i = 0; i < srv->easy_stealing_queue.workers_num(); i++)
+                                {
+                                    stealing_queue<http*>::worker_stats ws;
+                                    srv->easy_stealing_queue.get_worker_stats(i, ws);
+
+                                    pops_total += ws.pops;
+                                    steals_total += ws.steals;
+
+                                    snprintf(buff, 1024, "\t\t<worker id=\"%d\" queue=\"%d\" tasks=\"%llu\" steals=\"%llu\" steal_rate=\"%.4f\"/>\n",
+                                            (int)i, (int)ws.queue_len,
+                                            (unsigned long long)ws.pops,
+                                            (unsigned long long)ws.steals,
+                                            ws.pops ? (double)ws.steals / ws.pops : 0.0);
+                                    resp += buff;
+                                }
+
+                                snprintf(buff, 1024, "\t\t<tasks>%llu</tasks>\n\t\t<steals>%llu</steals>\n\t\t<steal_rate>%.4f</steal_rate>\n\t</easy_workers>\n",
+                                        (unsigned long long)pops_total,
+                                        (unsigned long long)steals_total,
+                                        pops_total ? (double)steals_total / pops_total : 0.0);
+                                resp += buff;
+                            }
+
+                            pthread_mutex_lock(&srv->acl_mutex);
+
+                            if (srv->acl_active)
+                            {
+                                const acl * a = srv->acl_active;
+
+                                snprintf(buff, 1024, "\t<acl>\n\t\t<rules>%d</rules>\n\t\t<allowed>%llu</allowed>\n\t\t<denied>%llu</denied>\n",
+                                        (int)a->rules_num(),
+                                        (unsigned long long)a->get_allowed_num(),
+                                        (unsigned long long)a->get_denied_num());
+                                resp += buff;
+
+                                for (size_t i = 0; i < a->rules_num(); i++)
+                                {
+                                    const acl::rule& r = a->get_rule(i);
+
+                                    if (r.hits)
+                                    {
+                                        snprintf(buff, 1024, "\t\t<rule hits=\"%llu\">%s</rule>\n",
+                                                (unsigned long long)r.hits, r.to_string().c_str());
+                                        resp += buff;
+                                    }
+                                }
+
+                                resp += "\t</acl>\n";
+                            }
+
+                            pthread_mutex_unlock(&srv->acl_mutex);
+
 
                             struct rusage usage;
                             ::getrusage(RUSAGE_SELF, &usage);
@@ -13,28 +13,198 @@
 */
 
 #include <lizard/statistics.hpp>
+#include <string.h>
 
 #define MAX_TIME 1e10
 
+static __thread lizard::statistics::shard * local_shard = 0;
+
+//---------------------------------------------------------------------------------------------
+
+// a shard has one writer (its thread) and the aggregator only reads it, so
+// relaxed loads and stores do; the last shard is shared by the threads beyond
+// MAX_SHARDS - 1 and keeps the atomic read-modify-write
+
+template <typename T>
+static inline void shard_add(T * p, T v, bool shared)
+{
+    if (shared)
+    {
+        __atomic_add_fetch(p, v, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+    }
+}
+
+template <typename T>
+static inline void shard_max(T * p, T v, bool shared)
+{
+    T cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+    if (!shared)
+    {
+        if (v > cur)
+        {
+            __atomic_store_n(p, v, __ATOMIC_RELAXED);
+        }
+
+        return;
+    }
+
+    while (v > cur && !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+template <typename T>
+static inline void shard_min(T * p, T v, bool shared)
+{
+    T cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+
+    if (!shared)
+    {
+        if (v < cur)
+        {
+            __atomic_store_n(p, v, __ATOMIC_RELAXED);
+        }
+
+        return;
+    }
+
+    while (v < cur && !__atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline void reset_window(lizard::statistics::shard * s, uint64_t w)
+{
+    __atomic_store_n(&s->resp_time_min, (uint64_t)-1, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->resp_time_max, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->eq_ml, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->hq_ml, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->dq_ml, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->window, w, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------------------------
+
 lizard::statistics::statistics()
 {
+    memset(shards, 0, sizeof(shards));
+    memset(shard_used, 0, sizeof(shard_used));
+    shards_num = 0;
+
+    pthread_mutex_init(&registry_mutex, 0);
+    pthread_key_create(&shard_key, &release_shard_key);
+
+    retired_requests_count = 0;
+    retired_resp_time_total = 0;
+
+    window = 0;
+
+    for (int i = 0; i < MAX_SHARDS; i++)
+    {
+        reset_window(shards + i, window);
+    }
+
     last_processed_time = time(0);
+    last_requests_count = 0;
+    last_resp_time_total = 0;
 
-    easy_queue_len = hard_queue_len = done_queue_len = 0;
     easy_queue_max_len = hard_queue_max_len = done_queue_max_len = 0;
-    eq_ml = hq_ml = dq_ml = 0;
+    done_queue_len = 0;
+
+    objects_in_http_pool = 0;
+    pages_in_http_pool = 0;
 
     avg_rps = 0;
 
-    requests_count = 0;
-    resp_time_total = 0;
     resp_time_min = (double)MAX_TIME + 1;
     resp_time_mid = 0;
     resp_time_max = 0;
-    min_t = 0;
-    max_t = 0;
 }
 
+lizard::statistics::~statistics()
+{
+    pthread_key_delete(shard_key);
+    pthread_mutex_destroy(&registry_mutex);
+}
+
+lizard::statistics::shard * lizard::statistics::get_shard()
+{
+    if (local_shard)
+    {
+        return local_shard;
+    }
+
+    pthread_mutex_lock(&registry_mutex);
+
+    int id = MAX_SHARDS - 1; // shared by everybody beyond the limit
+
+    for (int i = 0; i < MAX_SHARDS - 1; i++)
+    {
+        if (!shard_used[i])
+        {
+            shard_used[i] = true;
+            id = i;
+
+            break;
+        }
+    }
+
+    if (id + 1 > shards_num)
+    {
+        shards_num = id + 1;
+    }
+
+    pthread_mutex_unlock(&registry_mutex);
+
+    local_shard = shards + id;
+
+    if (id != MAX_SHARDS - 1)
+    {
+        pthread_setspecific(shard_key, local_shard);
+    }
+
+    return local_shard;
+}
+
+lizard::statistics::shard * lizard::statistics::get_window_shard()
+{
+    shard * s = get_shard();
+
+    uint64_t w = __atomic_load_n(&window, __ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&s->window, __ATOMIC_RELAXED) != w)
+    {
+        reset_window(s, w);
+    }
+
+    return s;
+}
+
+void lizard::statistics::release_shard(shard * s)
+{
+    pthread_mutex_lock(&registry_mutex);
+
+    retired_requests_count += s->requests_count;
+    retired_resp_time_total += s->resp_time_total;
+
+    s->requests_count = 0;
+    s->resp_time_total = 0;
+
+    shard_used[s - shards] = false;
+
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+extern lizard::statistics stats;
+
+void lizard::statistics::release_shard_key(void * ptr)
+{
+    stats.release_shard((shard *)ptr);
+}
+
+//---------------------------------------------------------------------------------------------
+
 double lizard::statistics::get_min_lifetime()const
 {
     return resp_time_min < MAX_TIME ? resp_time_min/1000.0 : 0;
@@ -55,78 +225,138 @@ double lizard::statistics::get_rps()const
      return avg_rps;
 }
 
-void lizard::statistics::process()
+uint64_t lizard::statistics::get_requests_count()const
 {
-    time_t curr_time = time(0);
+    pthread_mutex_lock(&registry_mutex);
 
-    double diff = curr_time - last_processed_time;
+    uint64_t res = retired_requests_count;
 
-    if (diff > TIME_DELTA)
+    for (int i = 0; i < shards_num; i++)
     {
-        resp_time_min = min_t;
-        resp_time_mid = requests_count ? (resp_time_total / (requests_count)) : 0;
-        resp_time_max = max_t;
+        res += __atomic_load_n(&shards[i].requests_count, __ATOMIC_RELAXED);
+    }
 
-        avg_rps = (double)requests_count / TIME_DELTA;
+    pthread_mutex_unlock(&registry_mutex);
 
-        easy_queue_max_len = eq_ml;
-        hard_queue_max_len = hq_ml;
-        done_queue_max_len = dq_ml;
+    return res;
+}
 
-        resp_time_total = 0;
-        requests_count = 0;
-        min_t = 0;
-        max_t = 0;
-        eq_ml = hq_ml = dq_ml = 0;
+int lizard::statistics::get_shards_num()const
+{
+    pthread_mutex_lock(&registry_mutex);
+    int res = shards_num;
+    pthread_mutex_unlock(&registry_mutex);
 
-        last_processed_time = curr_time;
-    }
+    return res;
 }
 
-void lizard::statistics::report_response_time(uint64_t t)
+void lizard::statistics::process()
 {
-    resp_time_total += t;
+    time_t curr_time = time(0);
 
-    if (t > max_t)
+    if (curr_time - last_processed_time <= TIME_DELTA)
     {
-        max_t = t;
+        return;
     }
 
-    if (t < min_t)
+    pthread_mutex_lock(&registry_mutex);
+
+    double diff = curr_time - last_processed_time;
+
+    if (diff <= TIME_DELTA)
     {
-        min_t = t;
+        pthread_mutex_unlock(&registry_mutex);
+        return;
     }
 
-    requests_count++;
+    uint64_t requests_count = retired_requests_count;
+    uint64_t resp_time_total = retired_resp_time_total;
+
+    uint64_t min_t = (uint64_t)-1;
+    uint64_t max_t = 0;
+    size_t eq_ml = 0, hq_ml = 0, dq_ml = 0;
+
+    for (int i = 0; i < shards_num; i++)
+    {
+        shard& s = shards[i];
+
+        requests_count += __atomic_load_n(&s.requests_count, __ATOMIC_RELAXED);
+        resp_time_total += __atomic_load_n(&s.resp_time_total, __ATOMIC_RELAXED);
+
+        // shards which reported nothing during this window hold older values
+        if (__atomic_load_n(&s.window, __ATOMIC_ACQUIRE) == window)
+        {
+            uint64_t v = __atomic_load_n(&s.resp_time_min, __ATOMIC_RELAXED);
+            if (v < min_t) min_t = v;
+
+            v = __atomic_load_n(&s.resp_time_max, __ATOMIC_RELAXED);
+            if (v > max_t) max_t = v;
+
+            size_t l = __atomic_load_n(&s.eq_ml, __ATOMIC_RELAXED);
+            if (l > eq_ml) eq_ml = l;
+
+            l = __atomic_load_n(&s.hq_ml, __ATOMIC_RELAXED);
+            if (l > hq_ml) hq_ml = l;
+
+            l = __atomic_load_n(&s.dq_ml, __ATOMIC_RELAXED);
+            if (l > dq_ml) dq_ml = l;
+        }
+    }
+
+    uint64_t window_requests = requests_count - last_requests_count;
+    uint64_t window_resp_time = resp_time_total - last_resp_time_total;
+
+    resp_time_min = window_requests ? (double)min_t : (double)MAX_TIME + 1;
+    resp_time_mid = window_requests ? (double)(window_resp_time / window_requests) : 0;
+    resp_time_max = max_t;
+
+    avg_rps = (double)window_requests / diff;
+
+    easy_queue_max_len = eq_ml;
+    hard_queue_max_len = hq_ml;
+    done_queue_max_len = dq_ml;
+
+    last_requests_count = requests_count;
+    last_resp_time_total = resp_time_total;
+
+    __atomic_add_fetch(&window, 1, __ATOMIC_RELEASE);
+
+    last_processed_time = curr_time;
+
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+void lizard::statistics::report_response_time(uint64_t t)
+{
+    shard * s = get_window_shard();
+    const bool shared = (s == shards + MAX_SHARDS - 1);
+
+    shard_add(&s->resp_time_total, t, shared);
+    shard_add(&s->requests_count, (uint64_t)1, shared);
+
+    shard_max(&s->resp_time_max, t, shared);
+    shard_min(&s->resp_time_min, t, shared);
 }
 
 void lizard::statistics::report_easy_queue_len(size_t len)
 {
-    easy_queue_len = len;
+    shard * s = get_window_shard();
 
-    if (len > eq_ml)
-    {
-        eq_ml = len;
-    }
+    shard_max(&s->eq_ml, len, s == shards + MAX_SHARDS - 1);
 }
 
 void lizard::statistics::report_hard_queue_len(size_t len)
 {
-    hard_queue_len = len;
+    shard * s = get_window_shard();
 
-    if (len > hq_ml)
-    {
-        hq_ml = len;
-    }
+    shard_max(&s->hq_ml, len, s == shards + MAX_SHARDS - 1);
 }
 
 void lizard::statistics::report_done_queue_len(size_t len)
 {
     done_queue_len = len;
 
-    if (len > dq_ml)
-    {
-        dq_ml = len;
-    }
-}
+    shard * s = get_window_shard();
 
+    shard_max(&s->dq_ml, len, s == shards + MAX_SHARDS - 1);
+}
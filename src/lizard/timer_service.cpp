@@ -0,0 +1,278 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <exception>
+#include <lizard/timer_service.hpp>
+#include <stdexcept>
+#include <stdio.h>
+#include <time.h>
+#include <utils/logger.hpp>
+
+static lizard::Logger& slogger = lizard::getLog("lizard");
+
+namespace lizard
+{
+    void * timer_loop_function(void * ptr);
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+lizard::timer_service::timer_service() : next_id(0), stopping(false), placement(0), runs(0), max_lag(0)
+{
+    pthread_mutex_init(&mutex, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    pthread_cond_init(&cond, &attr);
+
+    pthread_condattr_destroy(&attr);
+}
+
+lizard::timer_service::~timer_service()
+{
+    stop();
+
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&mutex);
+}
+
+uint64_t lizard::timer_service::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000LLU + ts.tv_nsec / 1000;
+}
+
+void lizard::timer_service::start(int threads_num, const thread_placement * pl)
+{
+    placement = pl;
+
+    for (int i = 0; i < threads_num; i++)
+    {
+        pthread_t th;
+
+        if (0 != pthread_create(&th, NULL, &timer_loop_function, this))
+        {
+            throw std::logic_error("error creating timer thread");
+        }
+
+        pthread_mutex_lock(&mutex);
+        threads.push_back(th);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    slogger.debug("%d timer threads created", threads_num);
+}
+
+void lizard::timer_service::stop()
+{
+    pthread_mutex_lock(&mutex);
+
+    stopping = true;
+    pthread_cond_broadcast(&cond);
+
+    std::vector<pthread_t> to_join;
+    to_join.swap(threads);
+
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < to_join.size(); i++)
+    {
+        pthread_join(to_join[i], 0);
+    }
+
+    pthread_mutex_lock(&mutex);
+
+    if (!active.empty())
+    {
+        slogger.debug("%d timers dropped", (int)active.size());
+    }
+
+    heap.clear();
+    active.clear();
+
+    stopping = false;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+uint64_t lizard::timer_service::schedule(uint64_t delay, uint64_t period, callback cb, void * arg)
+{
+    if (0 == cb)
+    {
+        return 0;
+    }
+
+    timer t;
+    t.when = now() + delay;
+    t.period = period;
+    t.cb = cb;
+    t.arg = arg;
+
+    pthread_mutex_lock(&mutex);
+
+    t.id = ++next_id;
+
+    heap.push_back(t);
+    std::push_heap(heap.begin(), heap.end(), later());
+
+    active.insert(t.id);
+
+    // a new earliest timer shortens the wait
+    if (heap.front().id == t.id)
+    {
+        pthread_cond_signal(&cond);
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    return t.id;
+}
+
+uint64_t lizard::timer_service::schedule_after(uint32_t ms, callback cb, void * arg)
+{
+    return schedule(ms * 1000LLU, 0, cb, arg);
+}
+
+uint64_t lizard::timer_service::schedule_every(uint32_t ms, callback cb, void * arg)
+{
+    if (0 == ms)
+    {
+        return 0;
+    }
+
+    return schedule(ms * 1000LLU, ms * 1000LLU, cb, arg);
+}
+
+bool lizard::timer_service::cancel(uint64_t id)
+{
+    pthread_mutex_lock(&mutex);
+    bool res = active.erase(id) > 0;
+    pthread_mutex_unlock(&mutex);
+
+    // the heap entry is dropped when it comes up
+    return res;
+}
+
+void lizard::timer_service::get_stats(stats& res)const
+{
+    pthread_mutex_lock(&mutex);
+
+    res.scheduled = active.size();
+    res.runs = runs;
+    res.max_lag = max_lag;
+
+    pthread_mutex_unlock(&mutex);
+}
+
+void lizard::timer_service::processing_loop()
+{
+    pthread_mutex_lock(&mutex);
+
+    while (!stopping)
+    {
+        if (heap.empty())
+        {
+            pthread_cond_wait(&cond, &mutex);
+            continue;
+        }
+
+        uint64_t curr = now();
+
+        if (heap.front().when > curr)
+        {
+            struct timespec ts;
+            ts.tv_sec = heap.front().when / 1000000;
+            ts.tv_nsec = (heap.front().when % 1000000) * 1000;
+
+            pthread_cond_timedwait(&cond, &mutex, &ts);
+            continue;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), later());
+        timer t = heap.back();
+        heap.pop_back();
+
+        if (0 == active.count(t.id))
+        {
+            continue; // cancelled
+        }
+
+        if (0 == t.period)
+        {
+            active.erase(t.id);
+        }
+
+        runs++;
+        max_lag = std::max(max_lag, curr - t.when);
+
+        pthread_mutex_unlock(&mutex);
+
+        try
+        {
+            t.cb(t.arg);
+        }
+        catch (const std::exception& e)
+        {
+            slogger.error("timer %llu: exception: %s", (unsigned long long)t.id, e.what());
+        }
+
+        pthread_mutex_lock(&mutex);
+
+        if (t.period && active.count(t.id))
+        {
+            t.when += t.period;
+
+            curr = now();
+            if (t.when + t.period <= curr)
+            {
+                t.when = curr; // fell behind, don't try to catch up
+            }
+
+            heap.push_back(t);
+            std::push_heap(heap.begin(), heap.end(), later());
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+void * lizard::timer_loop_function(void * ptr)
+{
+    lizard::timer_service * ts = (lizard::timer_service *)ptr;
+
+    static size_t ids = 0;
+    size_t id = __atomic_fetch_add(&ids, 1, __ATOMIC_RELAXED);
+
+    char name[16];
+    snprintf(name, sizeof(name), "lz-timer-%d", (int)id);
+
+    if (ts->placement)
+    {
+        // service threads 0 and 1 are lz-idle and lz-stats
+        ts->placement->apply(thread_placement::thService, 2 + id, name);
+    }
+
+    ts->processing_loop();
+
+    pthread_exit(NULL);
+}
+
+//-----------------------------------------------------------------------------------------------------------
@@ -0,0 +1,168 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <lizard/url_params.hpp>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//-----------------------------------------------------------------------------------------------------------
+
+namespace
+{
+
+inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+
+    c |= 0x20;
+
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+}
+
+//-----------------------------------------------------------------------------------------------------------
+
+size_t lizard::url_decode(const char * src, size_t len, char * dst)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i < len)
+    {
+#ifdef __SSE2__
+        const __m128i pct = _mm_set1_epi8('%');
+        const __m128i plus = _mm_set1_epi8('+');
+
+        // o <= i, the store stays inside dst[0, len)
+        while (i + 16 <= len)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+            int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, pct), _mm_cmpeq_epi8(v, plus)));
+
+            _mm_storeu_si128((__m128i *)(dst + o), v);
+
+            if (m)
+            {
+                int n = __builtin_ctz(m);
+
+                i += n;
+                o += n;
+
+                break;
+            }
+
+            i += 16;
+            o += 16;
+        }
+
+        if (i == len)
+        {
+            break;
+        }
+#endif
+
+        const char c = src[i];
+
+        if ('+' == c)
+        {
+            dst[o++] = ' ';
+            i++;
+        }
+        else if ('%' == c && i + 2 < len && hex_digit(src[i + 1]) >= 0 && hex_digit(src[i + 2]) >= 0)
+        {
+            dst[o++] = (char)(hex_digit(src[i + 1]) << 4 | hex_digit(src[i + 2]));
+            i += 3;
+        }
+        else
+        {
+            dst[o++] = c;
+            i++;
+        }
+    }
+
+    return o;
+}
+
+bool lizard::parse_params(const char * data, size_t len, arena& mem, request_params& res)
+{
+    res.items = 0;
+    res.num = 0;
+
+    if (0 == len)
+    {
+        return true;
+    }
+
+    size_t max_items = 1;
+
+    for (const char * p = data; (p = (const char *)memchr(p, '&', data + len - p)); p++)
+    {
+        max_items++;
+    }
+
+    // a decoded pair with its two NULs is at most one byte longer than the pair
+    request_params::item * items = (request_params::item *)mem.alloc(max_items * sizeof(request_params::item), sizeof(void *));
+    char * out = (char *)mem.alloc(len + 2 * max_items, 1);
+
+    if (!items || !out)
+    {
+        return false;
+    }
+
+    const char * end = data + len;
+    size_t num = 0;
+
+    for (const char * p = data; p < end; )
+    {
+        const char * amp = (const char *)memchr(p, '&', end - p);
+        if (!amp)
+        {
+            amp = end;
+        }
+
+        if (amp > p)
+        {
+            const char * eq = (const char *)memchr(p, '=', amp - p);
+            const char * val = eq ? eq + 1 : amp;
+
+            request_params::item& it = items[num++];
+
+            size_t sz = url_decode(p, (eq ? eq : amp) - p, out);
+            out[sz] = 0;
+            it.key = string_view(out, sz);
+            out += sz + 1;
+
+            sz = url_decode(val, amp - val, out);
+            out[sz] = 0;
+            it.value = string_view(out, sz);
+            out += sz + 1;
+        }
+
+        p = amp + 1;
+    }
+
+    res.items = items;
+    res.num = num;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------------------------------------
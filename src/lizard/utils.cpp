@@ -17,6 +17,7 @@
 #include <lizard/config.hpp>
 #include <lizard/utils.hpp>
 #include <netdb.h>
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <stdexcept>
 #include <string.h>
@@ -188,12 +189,14 @@ int lz_utils::add_sender(const char * host_desc, const char * port_desc)
     return fd;
 }
 
-int lz_utils::accept_new_connection(int fd, struct in_addr& ip)
+int lz_utils::accept_new_connection(int fd, struct in_addr& ip, struct sockaddr_storage * peer)
 {
     int connection;
-    struct sockaddr_in sa;
+    struct sockaddr_storage sa;
     socklen_t lsa = sizeof(sa);
 
+    memset(&sa, 0, sizeof(sa));
+
     do
     {
         connection = accept(fd, (struct sockaddr *) &sa, &lsa);
@@ -205,7 +208,23 @@ int lz_utils::accept_new_connection(int fd, struct in_addr& ip)
         slogger.error("accept failure: '%s'", strerror(errno));
     }
 
-    ip = sa.sin_addr;
+    if (AF_INET6 == sa.ss_family && IN6_IS_ADDR_V4MAPPED(&((struct sockaddr_in6 *)&sa)->sin6_addr))
+    {
+        memcpy(&ip, ((struct sockaddr_in6 *)&sa)->sin6_addr.s6_addr + 12, sizeof(ip));
+    }
+    else if (AF_INET6 == sa.ss_family)
+    {
+        memset(&ip, 0, sizeof(ip));
+    }
+    else
+    {
+        ip = ((struct sockaddr_in *)&sa)->sin_addr;
+    }
+
+    if (peer)
+    {
+        *peer = sa;
+    }
 
     return connection;
 }